@@ -16,6 +16,7 @@
  */
 
 #include <limits.h>
+#include <getopt.h>
 
 #include "atheepmgr.h"
 #include "utils.h"
@@ -201,7 +202,7 @@ search_by_pci_id:
 	return chip->eepmap;
 }
 
-static const struct eepmap *eepmap_find_by_name(const char *name)
+const struct eepmap *eepmap_find_by_name(const char *name)
 {
 	int i;
 
@@ -307,6 +308,9 @@ static int act_eep_save(struct atheepmgr *aem, int argc, char *argv[])
 		return -EINVAL;
 	}
 
+	if (aem->eepmap->fetch_eeprom && !aem->eepmap->fetch_eeprom(aem))
+		return -EIO;
+
 	fp = fopen(argv[0], "wb");
 	if (!fp) {
 		fprintf(stderr, "Unable to open output file for writing: %s\n",
@@ -386,6 +390,48 @@ static const struct eepmap_param {
 	}
 };
 
+/**
+ * Program the EEPROM with the updated image from the buffer. Only words that
+ * differ from the original contents are written, since each write is a slow
+ * EEPROM write cycle. Returns the number of words to write or -1 on error.
+ */
+static int eep_program(struct atheepmgr *aem, const uint16_t *orig)
+{
+	const uint16_t *buf = aem->eep_buf;
+	int addr, cnt = 0;
+
+	for (addr = 0; addr < aem->eep_len; ++addr)
+		if (buf[addr] != orig[addr])
+			cnt++;
+
+	if (aem->verbose || aem->dry_run)
+		printf("EEPROM programming: %d word(s) to write, estimated time %d ms\n",
+		       cnt, cnt * AH_EEP_WRITE_TIME);
+
+	if (aem->dry_run || !cnt)
+		return cnt;
+
+	EEP_UNLOCK();
+
+	for (addr = 0; addr < aem->eep_len; ++addr) {
+		if (buf[addr] == orig[addr])
+			continue;
+		if (aem->verbose > 1)
+			printf("Write EEPROM word 0x%04x: 0x%04x -> 0x%04x\n",
+			       addr, orig[addr], buf[addr]);
+		if (!EEP_WRITE(addr, buf[addr])) {
+			fprintf(stderr, "Unable to write EEPROM data at 0x%04x\n",
+				addr);
+			cnt = -1;
+			break;
+		}
+	}
+
+	EEP_LOCK();
+
+	return cnt;
+}
+
 static int act_eep_update(struct atheepmgr *aem, int argc, char *argv[])
 {
 	const struct eepmap *eepmap = aem->eepmap;
@@ -393,6 +439,7 @@ static int act_eep_update(struct atheepmgr *aem, int argc, char *argv[])
 	char *val;
 	int namelen;
 	uint8_t macaddr[6];
+	uint16_t *orig;
 	void *data;
 	bool res;
 
@@ -447,15 +494,202 @@ static int act_eep_update(struct atheepmgr *aem, int argc, char *argv[])
 		data = val;
 	}
 
-	EEP_UNLOCK();
+	if (eepmap->fetch_eeprom && !eepmap->fetch_eeprom(aem))
+		return -EIO;
 
-	res = eepmap->update_eeprom(aem, param->id, data);
+	orig = malloc(aem->eep_len * sizeof(uint16_t));
+	if (!orig) {
+		fprintf(stderr, "Unable to allocate memory for the EEPROM image copy\n");
+		return -ENOMEM;
+	}
+	memcpy(orig, aem->eep_buf, aem->eep_len * sizeof(uint16_t));
 
-	EEP_LOCK();
+	/* Eepmap updates the buffer, then changed words are written */
+	res = eepmap->update_eeprom(aem, param->id, data) &&
+	      eep_program(aem, orig) >= 0;
+
+	free(orig);
 
 	return res ? 0 : -EIO;
 }
 
+/**
+ * EEPROM access ops to parse an in-memory image in the same way as the EEPROM
+ * contents. Words beyond the image are read via the tail ops if any, or are
+ * considered unprogrammed otherwise.
+ */
+static bool eep_img_read(struct atheepmgr *aem, uint32_t off, uint16_t *data)
+{
+	if (off < aem->eep_img.len)
+		*data = aem->eep_img.buf[off];
+	else if (aem->eep_img.tail)
+		return aem->eep_img.tail->read(aem, off, data);
+	else
+		*data = 0xffff;
+
+	return true;
+}
+
+static const struct eep_ops eep_img = {
+	.read = eep_img_read,
+};
+
+/**
+ * Load the image via the in-memory EEPROM ops, returns the load result and
+ * keeps the byteswap, detected by the eepmap loader, in aem->eep_io_swap.
+ */
+static bool eep_img_load(struct atheepmgr *aem, const uint16_t *buf, int len,
+			 const struct eep_ops *tail)
+{
+	const struct eep_ops *eep = aem->eep;
+	bool res;
+
+	aem->eep_img.buf = buf;
+	aem->eep_img.len = len;
+	aem->eep_img.tail = tail;
+	aem->eep = &eep_img;
+	aem->eep_len = 0;
+	res = aem->eepmap->load_eeprom(aem, false);
+	aem->eep = eep;
+
+	return res;
+}
+
+static unsigned long words_per_sec(int cnt, uint64_t us)
+{
+	return us ? (uint64_t)cnt * 1000000 / us : 0;
+}
+
+static int act_eep_load(struct atheepmgr *aem, int argc, char *argv[])
+{
+	bool io_swap = aem->eep_io_swap;
+	size_t buf_sz = aem->eepmap->eep_buf_sz * sizeof(uint16_t);
+	uint16_t *img = NULL, *cur = NULL;
+	int ret = -EINVAL, len, addr, cnt, n, i;
+	uint64_t ts;
+	FILE *fp;
+	bool res;
+
+	if (!buf_sz) {
+		fprintf(stderr, "EEPROM map does not support buffered operation, so the content loading is not possible\n");
+		return -EOPNOTSUPP;
+	}
+
+	if (argc < 1) {
+		fprintf(stderr, "Input file for EEPROM loading is not specified, aborting\n");
+		return -EINVAL;
+	}
+
+	img = malloc(buf_sz);
+	cur = malloc(buf_sz);
+	if (!img || !cur) {
+		fprintf(stderr, "Unable to allocate memory for the EEPROM image\n");
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	fp = fopen(argv[0], "rb");
+	if (!fp) {
+		fprintf(stderr, "Unable to open input file for reading: %s\n",
+			strerror(errno));
+		ret = -errno;
+		goto exit;
+	}
+	len = fread(img, 1, buf_sz, fp);
+	res = fgetc(fp) == EOF;
+	fclose(fp);
+	if (!res) {
+		fprintf(stderr, "Image file is too big, EEPROM map supports up to %zu bytes\n",
+			buf_sz);
+		goto exit;
+	} else if (!len || len % sizeof(uint16_t)) {
+		fprintf(stderr, "Invalid image file size %d bytes\n", len);
+		goto exit;
+	}
+	len /= sizeof(uint16_t);
+
+	/* Reuse the already fetched EEPROM contents and fetch the rest */
+	n = aem->eep_len < len ? aem->eep_len : len;
+	memcpy(cur, aem->eep_buf, n * sizeof(uint16_t));
+	if (n < len && !EEP_READ_RANGE(n, &cur[n], len - n)) {
+		fprintf(stderr, "Unable to read EEPROM contents\n");
+		ret = -EIO;
+		goto exit;
+	}
+
+	/**
+	 * RAW contents are fetched without the byteswap compensation, while
+	 * the image is saved with it. So detect the byteswap by parsing the
+	 * fetched contents in the same way as the regular loading does and
+	 * program the image through it.
+	 */
+	if (!eep_img_load(aem, cur, len, aem->eep))
+		fprintf(stderr, "Unable to parse current EEPROM contents, the I/O byteswap detection could be inaccurate\n");
+	if (aem->eep_io_swap != io_swap) {
+		if (aem->verbose)
+			printf("Write EEPROM image with the I/O byteswap\n");
+		bswap_16_buf(cur, len);
+		io_swap = aem->eep_io_swap;
+	}
+
+	/* Validate the image by loading it in the same way as the EEPROM */
+	aem->eep_io_swap = false;
+	res = eep_img_load(aem, img, len, NULL) &&
+	      aem->eepmap->check_eeprom(aem);
+	aem->eep_io_swap = io_swap;
+	if (!res) {
+		fprintf(stderr, "Image validation failed, aborting\n");
+		goto exit;
+	}
+
+	memcpy(aem->eep_buf, img, len * sizeof(uint16_t));
+	aem->eep_len = len;
+
+	ts = hw_now_us();
+	cnt = eep_program(aem, cur);
+	if (cnt < 0) {
+		ret = -EIO;
+		goto exit;
+	}
+	ts = hw_now_us() - ts;
+	if (aem->dry_run) {
+		ret = 0;
+		goto exit;
+	}
+	printf("Written %d word(s) in %llu ms (%lu words/s)\n", cnt,
+	       (unsigned long long)ts / 1000, words_per_sec(cnt, ts));
+
+	/* Read back and verify by large batches */
+	ts = hw_now_us();
+	for (addr = 0; addr < len; addr += n) {
+		n = len - addr < 0x100 ? len - addr : 0x100;
+		if (!EEP_READ_RANGE(addr, cur, n)) {
+			fprintf(stderr, "Unable to read EEPROM for verification\n");
+			ret = -EIO;
+			goto exit;
+		}
+		if (memcmp(cur, &img[addr], n * sizeof(uint16_t)) == 0)
+			continue;
+		for (i = 0; cur[i] == img[addr + i]; ++i)
+			;
+		fprintf(stderr, "Verification failed at 0x%04x: 0x%04x, expected 0x%04x\n",
+			addr + i, cur[i], img[addr + i]);
+		ret = -EIO;
+		goto exit;
+	}
+	ts = hw_now_us() - ts;
+	printf("Verified %d word(s) in %llu ms (%lu words/s)\n", len,
+	       (unsigned long long)ts / 1000, words_per_sec(len, ts));
+
+	ret = 0;
+
+exit:
+	free(cur);
+	free(img);
+
+	return ret;
+}
+
 static int act_eep_tpl_export(struct atheepmgr *aem, int argc, char *argv[])
 {
 	const struct eepmap *eepmap = aem->eepmap;
@@ -527,6 +761,8 @@ static int act_gpio_dump(struct atheepmgr *aem, int argc, char *argv[])
 		return -EOPNOTSUPP;
 	}
 
+	hw_gpio_snapshot(aem, true);
+
 	FOR_EACH_GPIO("GPIO #")
 		printf(" %-3u", i);
 	printf("\n");
@@ -545,11 +781,105 @@ static int act_gpio_dump(struct atheepmgr *aem, int argc, char *argv[])
 		printf(" %c  ", aem->gpio->output_get(aem, i) ? '1' : ' ');
 	printf("\n");
 
+	hw_gpio_snapshot(aem, false);
+
 	return 0;
 
 #undef FOR_EACH_GPIO
 }
 
+#define GPIO_WATCH_TIME		10	/* Default watch duration, s */
+#define GPIO_WATCH_RING_SZ	1024	/* Max number of kept state changes */
+
+struct gpio_watch_sample {
+	uint64_t ts;			/* Since the watch start, us */
+	uint32_t in;			/* Input lines state bitmap */
+	uint32_t out;			/* Output lines state bitmap */
+};
+
+/**
+ * Continuously sample the GPIO lines state and record each state change to
+ * the ring buffer, which is printed at the end. The oldest changes are lost
+ * on the buffer overflow.
+ */
+static int act_gpio_watch(struct atheepmgr *aem, int argc, char *argv[])
+{
+	static struct gpio_watch_sample ring[GPIO_WATCH_RING_SZ];
+	unsigned long duration = GPIO_WATCH_TIME;
+	unsigned long nsamples = 0, nchanges = 0;
+	struct gpio_watch_sample *s;
+	uint64_t start, end, now;
+	unsigned head = 0, num = 0;
+	uint32_t in, out;
+	int width, i;
+	char *endp;
+
+	if (argc > 0) {
+		errno = 0;
+		duration = strtoul(argv[0], &endp, 10);
+		if (*endp != '\0' || errno || !duration) {
+			fprintf(stderr, "Invalid watch duration -- %s\n",
+				argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (!aem->gpio) {
+		fprintf(stderr, "GPIO control is not supported for this chip, aborting\n");
+		return -EOPNOTSUPP;
+	}
+
+	printf("Watch GPIO lines state for %lu s\n", duration);
+
+	start = hw_now_us();
+	end = start + duration * 1000000;
+	do {
+		hw_gpio_snapshot(aem, true);
+		now = hw_now_us();
+
+		in = 0;
+		out = 0;
+		for (i = 0; i < aem->gpio_num; ++i) {
+			in |= !!aem->gpio->input_get(aem, i) << i;
+			out |= !!aem->gpio->output_get(aem, i) << i;
+		}
+
+		s = &ring[(head + GPIO_WATCH_RING_SZ - 1) % GPIO_WATCH_RING_SZ];
+		if (!nsamples || s->in != in || s->out != out) {
+			s = &ring[head];
+			s->ts = now - start;
+			s->in = in;
+			s->out = out;
+			head = (head + 1) % GPIO_WATCH_RING_SZ;
+			if (num < GPIO_WATCH_RING_SZ)
+				num++;
+			nchanges++;
+		}
+		nsamples++;
+	} while (now < end);
+
+	hw_gpio_snapshot(aem, false);
+
+	printf("Taken %lu samples (%lu samples/s), %lu state changes\n",
+	       nsamples, nsamples / duration, nchanges - 1);
+	if (nchanges > num)
+		printf("Only the last %u changes are kept\n", num);
+
+	width = (aem->gpio_num + 3) / 4;
+	printf("%14s  %*s  %*s\n", "Time, s", width + 2, "In",
+	       width + 2, "Out");
+	for (i = 0; i < num; ++i) {
+		s = &ring[(head + GPIO_WATCH_RING_SZ - num + i) %
+			  GPIO_WATCH_RING_SZ];
+		printf("%7lu.%06lu  0x%0*x  0x%0*x\n",
+		       (unsigned long)(s->ts / 1000000),
+		       (unsigned long)(s->ts % 1000000), width, s->in,
+		       width, s->out);
+	}
+
+	return 0;
+}
+
 static int act_reg_read(struct atheepmgr *aem, int argc, char *argv[])
 {
 	unsigned long addr;
@@ -600,6 +930,7 @@ static int act_reg_write(struct atheepmgr *aem, int argc, char *argv[])
 	}
 
 	REG_WRITE(addr, val);
+	hw_reg_shadow_invalidate(aem);
 
 	return 0;
 }
@@ -636,6 +967,10 @@ static const struct action {
 		.name = "saverawotp",
 		.func = act_eep_save,
 		.flags = ACT_F_DATA | ACT_F_RAW_OTP,
+	}, {
+		.name = "load",
+		.func = act_eep_load,
+		.flags = ACT_F_DATA | ACT_F_RAW_EEP,
 	}, {
 		.name = "unpack",
 		.func = act_eep_unpack,
@@ -652,6 +987,10 @@ static const struct action {
 		.name = "gpiodump",
 		.func = act_gpio_dump,
 		.flags = ACT_F_HW,
+	}, {
+		.name = "gpiowatch",
+		.func = act_gpio_watch,
+		.flags = ACT_F_HW,
 	}, {
 		.name = "regread",
 		.func = act_reg_read,
@@ -678,6 +1017,13 @@ static const struct action {
 #define CON_USAGE_PCI		""
 #define CON_OPTSTR_PCI		""
 #endif
+#if defined(CONFIG_CON_SYSFS)
+#define CON_USAGE_SYSFS		" | -S <slot>"
+#define CON_OPTSTR_SYSFS	"S:"
+#else
+#define CON_USAGE_SYSFS		""
+#define CON_OPTSTR_SYSFS	""
+#endif
 #if defined(CONFIG_CON_DRIVER)
 #define CON_USAGE_DRIVER	" | -D <dev>"
 #define CON_OPTSTR_DRIVER	"D:"
@@ -686,14 +1032,18 @@ static const struct action {
 #define CON_OPTSTR_DRIVER	""
 #endif
 
-#define CON_OPTSTR	"F:" CON_OPTSTR_MEM CON_OPTSTR_PCI CON_OPTSTR_DRIVER
-#if defined(CONFIG_CON_MEM) || defined(CONFIG_CON_PCI) || defined(CONFIG_CON_DRIVER)
-#define CON_USAGE	"{" CON_USAGE_FILE CON_USAGE_MEM CON_USAGE_PCI CON_USAGE_DRIVER "}"
-#else
-#define CON_USAGE	CON_USAGE_FILE
-#endif
+#define CON_USAGE_SIM		" | -E <image>"
+#define CON_USAGE_TRACE		" | -R <trace>"
+
+#define CON_OPTSTR	"F:E:R:" CON_OPTSTR_MEM CON_OPTSTR_PCI CON_OPTSTR_SYSFS CON_OPTSTR_DRIVER
+#define CON_USAGE	"{" CON_USAGE_FILE CON_USAGE_MEM CON_USAGE_PCI CON_USAGE_SYSFS CON_USAGE_DRIVER CON_USAGE_SIM CON_USAGE_TRACE "}"
 
-static const char *optstr = CON_OPTSTR "ht:v";
+static const char *optstr = CON_OPTSTR "d:hnt:vW:";
+
+static const struct option longopts[] = {
+	{"deadline", required_argument, NULL, 'd'},
+	{NULL, 0, NULL, 0}
+};
 
 static int strptrcmp(const void *a, const void *b)
 {
@@ -809,7 +1159,7 @@ static void usage(struct atheepmgr *aem, char *name)
 		"Copyright (c) 2013-2025, Sergey Ryazanov <ryazanov.s.a@gmail.com>\n"
 		"\n"
 		"Usage:\n"
-		"  %s " CON_USAGE " [-t <eepmap>] [<action> [<actarg>]]\n"
+		"  %s " CON_USAGE " [-W <trace>] [-t <eepmap>] [-d <sec>] [-n] [<action> [<actarg>]]\n"
 		"or\n"
 		"  %s -h\n"
 		"\n"
@@ -827,6 +1177,11 @@ static void usage(struct atheepmgr *aem, char *name)
 		"                  If <func> is omitted then first available function will be\n"
 		"                  used.\n"
 #endif
+#if defined(CONFIG_CON_SYSFS)
+		"  -S <slot>       Interact with card installed in <slot> via the Linux sysfs by\n"
+		"                  mapping its BAR0 resource file to the process. Slot should be\n"
+		"                  specified in the same form as for the -P option.\n"
+#endif
 #if defined(CONFIG_CON_DRIVER)
 		"  -D <dev>        Use driver debug interface to interact with <dev> card.\n"
 #if defined(__linux__)
@@ -834,6 +1189,22 @@ static void usage(struct atheepmgr *aem, char *name)
 		"                  or as a network device/interface (e.g. wlan0, wlan1)\n"
 #endif
 #endif
+		"  -E <image>[,<opt>[,...]]\n"
+		"                  Interact with a simulated chip, which EEPROM (or OTP mem)\n"
+		"                  contents are stored in the <image> file. Options are:\n"
+		"                  otp - <image> contains OTP mem instead of EEPROM contents,\n"
+		"                  srev=<val> - chip SREV value (by default, a value is\n"
+		"                  selected according to the EEPROM map),\n"
+		"                  lat=<us> - EEPROM/OTP read latency (default: 0),\n"
+		"                  wlat=<us> - EEPROM write latency (default: 0),\n"
+		"                  reglat=<us> - register access latency (default: 0).\n"
+		"  -R <trace>[,<lat>|,rec]\n"
+		"                  Replay the register accesses recorded to the <trace> file\n"
+		"                  instead of interacting with a real card. Optionally, each\n"
+		"                  access could be delayed by <lat> microseconds or by the\n"
+		"                  recorded delay ('rec' keyword).\n"
+		"  -W <trace>      Record each register access, performed via the main connector,\n"
+		"                  to the <trace> file for a further replay.\n"
 		"  -t <eepmap>     Override EEPROM map type (see below), this option is required\n"
 		"                  for connectors, without PnP (map type autodetection) support.\n"
 		"                  EEPROM map type could be specified by its name or by a name of\n"
@@ -845,6 +1216,14 @@ static void usage(struct atheepmgr *aem, char *name)
 		"                  shure about an exact chip type. So you could check PCI Id with\n"
 		"                  help of pciconf(8)/lspci(8)/pcidump(8) utility and then use\n"
 		"                  obtained identifier to specify chip (and EEPROM map) type.\n"
+		"  -d <sec>, --deadline <sec>\n"
+		"                  Limit the total time of waiting for the card (EEPROM and OTP\n"
+		"                  engines status polling) by <sec> seconds. Single register\n"
+		"                  accesses and connector I/O are not limited. If the card does\n"
+		"                  not respond or the wait budget is over, then the utility\n"
+		"                  exits with the ETIMEDOUT error code.\n"
+		"  -n              Dry run. Do not modify the EEPROM contents, just print the\n"
+		"                  number of words to write and the estimated write time.\n"
 		"  -v              Be verbose. I.e. print detailed help message, log action\n"
 		"                  stages, print all EEPROM data including unused parameters.\n"
 		"  -h              Print this cruft. Use -v option to see more details.\n"
@@ -879,6 +1258,10 @@ static void usage(struct atheepmgr *aem, char *name)
 			"                  without any other (e.g. OTP) memory types access.\n"
 			"  saverawotp <file> Same as 'saveraw', but saves only the OTP mem contents\n"
 			"                  without any other (e.g. EEPROM) memory types access.\n"
+			"  load <file>     Validate the EEPROM image from the file <file> (e.g. saved\n"
+			"                  earlier with 'save' action) and write it to the EEPROM.\n"
+			"                  Only the differing words are written, then the EEPROM\n"
+			"                  contents are verified.\n"
 			"  unpack <file>   Save unpacked EEPROM/OTP data to the file <file>. Saved data\n"
 			"                  type depends on EEPROM map type, usually only calibration\n"
 			"                  data are saved.\n"
@@ -887,6 +1270,9 @@ static void usage(struct atheepmgr *aem, char *name)
 			"  templateexport <name-or-id> <file> Export template specified by Name or by Id\n"
 			"                  to the file <file>.\n"
 			"  gpiodump        Dump GPIO lines state to the terminal.\n"
+			"  gpiowatch [<time>] Sample GPIO lines state as fast as possible for <time>\n"
+			"                  seconds (10 by default) and print each lines state change\n"
+			"                  (up to 1024 last changes) as inputs and outputs bitmaps.\n"
 			"  regread <addr>  Read register at address <addr> and print it value.\n"
 			"  regwrite <addr> <val> Write value <val> to the register at address <addr>.\n"
 			"\n"
@@ -897,10 +1283,12 @@ static void usage(struct atheepmgr *aem, char *name)
 			"  dump [<sects>]  Read & dump parsed EEPROM content to the terminal.\n"
 			"  save <file>     Save fetched raw EEPROM content to the file <file>.\n"
 			/* NB: 'saveraw' intentionally skipped to keep usage short. */
+			"  load <file>     Write EEPROM image from the file <file> to the EEPROM.\n"
 			"  unpack <file>   Save unpacked EEPROM/OTP calibration data to the file <file>.\n"
 			"  update <param>[=<val>]  Set EEPROM parameter <param> to <val>.\n"
 			/* NB: 'templateexport' intentionally skipped to keep usage short. */
 			"  gpiodump        Dump GPIO lines state to the terminal.\n"
+			"  gpiowatch [<time>] Watch GPIO lines state changes for <time> seconds.\n"
 			"  regread <addr>  Read register at address <addr> and print it value.\n"
 			"  regwrite <addr> <val> Write value <val> to the register at address <addr>.\n"
 			"\n"
@@ -926,6 +1314,18 @@ static void usage(struct atheepmgr *aem, char *name)
 		"  PCI             Interact with card via libpciaccess library, activated by -P\n"
 		"                  option with a device slot arg.\n"
 #endif
+		"  Sim             Emulate chip EEPROM and OTP controllers with memory contents\n"
+		"                  stored in a file, activated by -E option with the image file\n"
+		"                  path argument.\n"
+#if defined(CONFIG_CON_SYSFS)
+		"  Sysfs           Interact with PCI card via Linux sysfs device resource file,\n"
+		"                  activated by -S option with a device slot arg. Unlike the\n"
+		"                  PCI connector does not scan the whole bus.\n"
+#endif
+		"  Trace           Replay the register accesses trace, activated by -R option\n"
+		"                  with the trace file path argument. The trace itself could be\n"
+		"                  recorded with any other hardware connector with help of -W\n"
+		"                  option.\n"
 		"\n"
 	);
 
@@ -945,6 +1345,9 @@ int main(int argc, char *argv[])
 	const struct eepmap *user_eepmap = NULL;
 	bool print_usage = false;
 	char *con_arg = NULL;
+	char *trace_fname = NULL;
+	double deadline = 0;
+	char *endp;
 	int i, opt;
 	int ret;
 
@@ -956,7 +1359,7 @@ int main(int argc, char *argv[])
 	aem->eep_wp_gpio_pol = 0;		/* Unlock by low level */
 
 	ret = -EINVAL;
-	while ((opt = getopt(argc, argv, optstr)) != -1) {
+	while ((opt = getopt_long(argc, argv, optstr, longopts, NULL)) != -1) {
 		switch (opt) {
 		case 'F':
 			aem->con = &con_file;
@@ -974,12 +1377,38 @@ int main(int argc, char *argv[])
 			con_arg = optarg;
 			break;
 #endif
+#if defined(CONFIG_CON_SYSFS)
+		case 'S':
+			aem->con = &con_sysfs;
+			con_arg = optarg;
+			break;
+#endif
 #if defined(CONFIG_CON_DRIVER)
 		case 'D':
 			aem->con = &con_driver;
 			con_arg = optarg;
 			break;
 #endif
+		case 'E':
+			aem->con = &con_sim;
+			con_arg = optarg;
+			break;
+		case 'R':
+			aem->con = &con_trace_play;
+			con_arg = optarg;
+			break;
+		case 'W':
+			trace_fname = optarg;
+			break;
+		case 'd':
+			errno = 0;
+			deadline = strtod(optarg, &endp);
+			if (errno || *endp != '\0' || deadline <= 0) {
+				fprintf(stderr, "Invalid deadline value -- %s\n",
+					optarg);
+				goto exit;
+			}
+			break;
 		case 't':
 			user_eepmap = eepmap_find_by_name(optarg);
 			if (!user_eepmap)
@@ -990,6 +1419,9 @@ int main(int argc, char *argv[])
 				goto exit;
 			}
 			break;
+		case 'n':
+			aem->dry_run = true;
+			break;
 		case 'v':
 			aem->verbose++;
 			break;
@@ -1032,6 +1464,14 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (trace_fname) {
+		if (!(aem->con->caps & CON_CAP_HW)) {
+			fprintf(stderr, "Register access recording requires a hardware connector\n");
+			goto exit;
+		}
+		aem->con = con_trace_rec_wrap(aem->con, trace_fname);
+	}
+
 	if ((act->flags & ACT_F_HW) && !(aem->con->caps & CON_CAP_HW)) {
 		fprintf(stderr, "%s action require direct HW access, which is not proved by %s connector\n",
 			act->name, aem->con->name);
@@ -1050,6 +1490,9 @@ int main(int argc, char *argv[])
 		goto exit;
 	}
 
+	if (deadline)
+		hw_deadline_set(aem, deadline * 1000);
+
 	ret = aem->con->init(aem, con_arg);
 	if (ret)
 		goto exit;
@@ -1196,7 +1639,20 @@ loading_done:
 
 	ret = act->func(aem, argc - optind, argv + optind);
 
+	/* Store buffered changes of the successful action, report failures */
+	if (!ret && aem->con->flush)
+		ret = aem->con->flush(aem);
+
 con_clean:
+	if (ret && hw_is_dead(aem))
+		ret = -ETIMEDOUT;	/* Distinct code for a wedged card */
+
+	if (aem->verbose && aem->wait_stats.waits)
+		printf("Reg polling: %lu waits, %lu polls, %lu timeouts, %llu us total\n",
+		       aem->wait_stats.waits, aem->wait_stats.polls,
+		       aem->wait_stats.timeouts,
+		       (unsigned long long)aem->wait_stats.time);
+
 	aem->con->clean(aem);
 
 exit:
@@ -135,6 +135,10 @@
 
 #define AH_WAIT_TIMEOUT		100000 /* (us) */
 #define AH_TIME_QUANTUM		10
+#define AH_WAIT_SPIN_TIME	50	/* (us) */
+#define AH_WAIT_SLEEP_MAX	1000	/* (us) */
+#define AH_DEAD_TIMEOUTS	3	/* Consecutive timeouts to give up */
+#define AH_EEP_WRITE_TIME	5	/* Typical EEPROM word write time (ms) */
 
 #define CON_CAP_HW		1	/* Con. is able to interact with HW */
 #define CON_CAP_PNP		2	/* Con. is able to detect EEP layout */
@@ -145,6 +149,7 @@
 struct atheepmgr;
 
 struct gpio_ops {
+	void (*snapshot)(struct atheepmgr *aem);
 	int (*input_get)(struct atheepmgr *aem, unsigned gpio);
 	int (*output_get)(struct atheepmgr *aem, unsigned gpio);
 	void (*output_set)(struct atheepmgr *aem, unsigned gpio, int val);
@@ -160,6 +165,8 @@ struct blob_ops {
 
 struct eep_ops {
 	bool (*read)(struct atheepmgr *aem, uint32_t off, uint16_t *data);
+	bool (*read_range)(struct atheepmgr *aem, uint32_t off, uint16_t *buf,
+			   unsigned int cnt);	/* Optional */
 	bool (*write)(struct atheepmgr *aem, uint32_t off, uint16_t data);
 	void (*lock)(struct atheepmgr *aem, int lock);
 };
@@ -167,18 +174,34 @@ struct eep_ops {
 struct otp_ops {
 	bool (*enable)(struct atheepmgr *aem, int enable);
 	bool (*read)(struct atheepmgr *aem, uint32_t off, uint8_t *data);
+	bool (*read_bulk)(struct atheepmgr *aem, uint32_t off, uint8_t *buf,
+			  unsigned int len);	/* Optional */
+};
+
+enum con_wait_strategy {
+	CON_WAIT_ADAPTIVE = 0,	/* Spin for a while, then sleep with backoff */
+	CON_WAIT_SPIN,		/* Busy polling, for fast direct reg access */
+	CON_WAIT_SLEEP,		/* Sleep between polls, for slow reg access */
 };
 
 struct connector {
 	const char *name;
 	size_t priv_data_sz;
 	unsigned int caps;
+	enum con_wait_strategy wait;	/* Reg polling strategy */
 	int (*init)(struct atheepmgr *aem, const char *arg_str);
 	void (*clean)(struct atheepmgr *aem);
+	/* Optional: store buffered changes, returns zero or error code */
+	int (*flush)(struct atheepmgr *aem);
 	uint32_t (*reg_read)(struct atheepmgr *aem, uint32_t reg);
 	void (*reg_write)(struct atheepmgr *aem, uint32_t reg, uint32_t val);
 	void (*reg_rmw)(struct atheepmgr *aem, uint32_t reg, uint32_t set,
 			uint32_t clr);
+	/* Optional: access a range of adjacent registers, starting from reg */
+	void (*reg_read_bulk)(struct atheepmgr *aem, uint32_t reg,
+			      uint32_t *buf, unsigned int cnt);
+	void (*reg_write_bulk)(struct atheepmgr *aem, uint32_t reg,
+			       const uint32_t *buf, unsigned int cnt);
 	const struct blob_ops *blob;
 	const struct eep_ops *eep;
 	const struct otp_ops *otp;
@@ -225,6 +248,7 @@ struct eepmap {
 	bool (*load_blob)(struct atheepmgr *aem);
 	bool (*load_eeprom)(struct atheepmgr *aem, bool raw);
 	bool (*load_otp)(struct atheepmgr *aem, bool raw);
+	bool (*fetch_eeprom)(struct atheepmgr *aem);	/* Complete lazy load */
 	bool (*check_eeprom)(struct atheepmgr *aem);
 	void (*dump[EEP_SECT_MAX])(struct atheepmgr *aem);
 	bool (*update_eeprom)(struct atheepmgr *aem, int param,
@@ -242,8 +266,20 @@ struct chip {
 	struct chip_pciid pciids[4];	/* Allow multiple IDs */
 };
 
+struct hw_reg_shadow {
+	uint32_t reg;
+	uint32_t val;				/* Last written value */
+	bool valid;
+};
+
+struct hw_health {
+	unsigned int timeouts;			/* Consecutive timeouts */
+	bool dead;				/* Engine is not responding */
+};
+
 struct atheepmgr {
 	int verbose;
+	bool dry_run;				/* Do not modify EEPROM */
 
 	bool host_is_be;			/* Is host big-endian? */
 
@@ -267,19 +303,50 @@ struct atheepmgr {
 	int eep_wp_gpio_pol;			/* EEPROM WP unlock polarity */
 
 	const struct eep_ops *eep;
+	struct {				/* Image for the load action */
+		const uint16_t *buf;
+		int len;
+		const struct eep_ops *tail;	/* Ops beyond image, optional */
+	} eep_img;
 
 	const struct otp_ops *otp;
 	bool otp_was_enabled;
+	uint32_t otp_cache_off;			/* OTP read-ahead cache start */
+	uint32_t otp_cache_len;			/* 0 - cache is empty */
+	uint8_t otp_cache[0x400];
+
+	struct {
+		unsigned long waits;		/* Number of hw_wait() calls */
+		unsigned long polls;		/* Number of reg polls */
+		unsigned long timeouts;
+		uint64_t time;			/* Total waiting time, us */
+	} wait_stats;
+	uint64_t deadline;			/* Monotonic time, us, 0 - none */
+	bool deadline_expired;
+	struct hw_health eep_health;
+	struct hw_health otp_health;
+
+	struct hw_reg_shadow reg_shadow[4];	/* Control regs write shadow */
+	unsigned reg_shadow_num;
 
 	const struct gpio_ops *gpio;
 	unsigned gpio_num;			/* Number of GPIO lines */
+	uint32_t gpio_snap_base;		/* GPIO registers snapshot */
+	unsigned gpio_snap_cnt;			/* 0 - no snapshot */
+	uint32_t gpio_snap[12];
 };
 
 extern const struct connector con_file;
 extern const struct connector con_driver;
 extern const struct connector con_mem;
 extern const struct connector con_pci;
+extern const struct connector con_sim;
+extern const struct connector con_sysfs;
 extern const struct connector con_stub;
+extern const struct connector con_trace_play;
+
+const struct connector *con_trace_rec_wrap(const struct connector *con,
+					   const char *fname);
 
 extern const struct eepmap eepmap_5211;
 extern const struct eepmap eepmap_5416;
@@ -290,21 +357,40 @@ extern const struct eepmap eepmap_9300;
 extern const struct eepmap eepmap_9880;
 extern const struct eepmap eepmap_9888;
 
+const struct eepmap *eepmap_find_by_name(const char *name);
 int chips_find_by_pci_id(uint16_t dev_id, const struct chip *res[], int nmemb);
 
 bool hw_wait(struct atheepmgr *aem, uint32_t reg, uint32_t mask,
 	     uint32_t val, uint32_t timeout);
+uint64_t hw_now_us(void);
+void hw_deadline_set(struct atheepmgr *aem, unsigned long timeout);
+bool hw_is_dead(struct atheepmgr *aem);
+bool hw_wait_status(struct atheepmgr *aem, uint32_t reg, uint32_t mask,
+		    uint32_t val, uint32_t timeout, uint32_t *status);
 void hw_eeprom_set_ops(struct atheepmgr *aem);
 bool hw_eeprom_read(struct atheepmgr *aem, uint32_t off, uint16_t *data);
+bool hw_eeprom_read_range(struct atheepmgr *aem, uint32_t off, uint16_t *buf,
+			  unsigned int cnt);
 bool hw_eeprom_write(struct atheepmgr *aem, uint32_t off, uint16_t data);
 void hw_eeprom_lock(struct atheepmgr *aem, int lock);
 void hw_otp_set_ops(struct atheepmgr *aem);
 bool hw_otp_enable(struct atheepmgr *aem, int enable);
 bool hw_otp_read(struct atheepmgr *aem, uint32_t off, uint8_t *data);
+bool hw_otp_read_bulk(struct atheepmgr *aem, uint32_t off, uint8_t *buf,
+		      unsigned int len);
+void hw_reg_read_bulk(struct atheepmgr *aem, uint32_t reg, uint32_t *buf,
+		      unsigned int cnt);
+void hw_reg_write_bulk(struct atheepmgr *aem, uint32_t reg,
+		       const uint32_t *buf, unsigned int cnt);
+void hw_gpio_snapshot(struct atheepmgr *aem, bool enable);
+void hw_reg_shadow_invalidate(struct atheepmgr *aem);
+uint32_t hw_regs_footprint(struct atheepmgr *aem);
 int hw_init(struct atheepmgr *aem);
 
 #define EEP_READ(_off, _data)		\
 		hw_eeprom_read(aem, _off, _data)
+#define EEP_READ_RANGE(_off, _buf, _cnt)	\
+		hw_eeprom_read_range(aem, _off, _buf, _cnt)
 #define EEP_WRITE(_off, _data)		\
 		hw_eeprom_write(aem, _off, _data)
 #define EEP_LOCK()			\
@@ -317,11 +403,17 @@ int hw_init(struct atheepmgr *aem);
 		hw_otp_enable(aem, 0);
 #define OTP_READ(_off, _data)		\
 		hw_otp_read(aem, _off, _data)
+#define OTP_READ_BULK(_off, _buf, _len)	\
+		hw_otp_read_bulk(aem, _off, _buf, _len)
 #define REG_READ(_reg)			\
 		aem->con->reg_read(aem, _reg)
 #define REG_WRITE(_reg, _val)		\
 		aem->con->reg_write(aem, _reg, _val)
 #define REG_RMW(_reg, _set, _clr)	\
 		aem->con->reg_rmw(aem, _reg, _set, _clr)
+#define REG_READ_BULK(_reg, _buf, _cnt)	\
+		hw_reg_read_bulk(aem, _reg, _buf, _cnt)
+#define REG_WRITE_BULK(_reg, _buf, _cnt)	\
+		hw_reg_write_bulk(aem, _reg, _buf, _cnt)
 
 #endif /* ATHEEPMGR_H */
@@ -0,0 +1,671 @@
+/*
+ * Copyright (c) 2020 Sergey Ryazanov <ryazanov.s.a@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Microbenchmarks for the hot paths of the utility. Each benchmark compares
+ * the former implementation of some code with the current one and prints the
+ * number of operations per second for both of them.
+ */
+
+#include <time.h>
+#include <sys/stat.h>
+
+#include "atheepmgr.h"
+#include "utils.h"
+#include "lzma.h"
+#include "eep_common.h"
+#include "eep_9300.h"
+#include "eep_9300_templates.h"
+#include "eep_9880.h"
+#include "eep_9880_templates.h"
+
+struct bench {
+	const char *name;
+	const char *desc;
+	int (*run)(void);
+};
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_report(const char *what, unsigned long ops, double t)
+{
+	printf("  %-28s %10lu ops in %7.3f s, %12.0f ops/s\n", what, ops, t,
+	       ops / t);
+}
+
+#ifdef CONFIG_CON_DRIVER
+/**
+ * Driver connector register access: the former reopen-per-access stdio
+ * pattern vs. the driver connector itself. The connector is pointed to a
+ * fake sysfs and debugfs tree in a temporary directory, where the debugfs
+ * files are substituted by regular files, so the numbers show the userspace
+ * and syscall overhead only.
+ */
+
+#define BENCH_DRV_ITERS		20000
+
+static char bench_drv_dir[] = "/tmp/atheepmgr-bench.XXXXXX";
+
+/* Fake tree directories, in the creation order */
+static const char * const bench_drv_dirs[] = {
+	"/sys",
+	"/sys/class",
+	"/sys/class/ieee80211",
+	"/sys/class/ieee80211/phy0",
+	"/sys/class/ieee80211/phy0/device",
+	"/dbg",
+	"/dbg/ieee80211",
+	"/dbg/ieee80211/phy0",
+	"/dbg/ieee80211/phy0/ath9k",
+};
+
+#define BENCH_DRV_DRIVER	"/sys/class/ieee80211/phy0/device/driver"
+#define BENCH_DRV_REGIDX	"/dbg/ieee80211/phy0/ath9k/regidx"
+#define BENCH_DRV_REGVAL	"/dbg/ieee80211/phy0/ath9k/regval"
+
+static char *bench_drv_path(const char *name)
+{
+	static char buf[sizeof(bench_drv_dir) + 0x40];
+
+	snprintf(buf, sizeof(buf), "%s%s", bench_drv_dir, name);
+
+	return buf;
+}
+
+static int bench_drv_reg_read_stdio(uint32_t reg, uint32_t *pval)
+{
+	unsigned int v;
+	FILE *fp;
+	int n, l;
+
+	fp = fopen(bench_drv_path(BENCH_DRV_REGIDX), "w");
+	if (!fp)
+		return -1;
+	if (fprintf(fp, "0x%08x\n", reg) != 11) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	fp = fopen(bench_drv_path(BENCH_DRV_REGVAL), "r");
+	if (!fp)
+		return -1;
+	n = fscanf(fp, "0x%8x%n", &v, &l);
+	fclose(fp);
+	if (n != 1 || l != 10)
+		return -1;
+	*pval = v;
+
+	return 0;
+}
+
+static int bench_drv_tree_create(void)
+{
+	static const char regval[] = "0x12345678\n";
+	FILE *fp;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(bench_drv_dirs); ++i)
+		if (mkdir(bench_drv_path(bench_drv_dirs[i]), 0700))
+			return -1;
+
+	if (symlink("../../../../bus/pci/drivers/ath9k",
+		    bench_drv_path(BENCH_DRV_DRIVER)))
+		return -1;
+
+	fp = fopen(bench_drv_path(BENCH_DRV_REGIDX), "w");
+	if (!fp || fclose(fp))
+		return -1;
+
+	fp = fopen(bench_drv_path(BENCH_DRV_REGVAL), "w");
+	if (!fp)
+		return -1;
+	if (fputs(regval, fp) == EOF) {
+		fclose(fp);
+		return -1;
+	}
+
+	return fclose(fp);
+}
+
+static void bench_drv_tree_remove(void)
+{
+	int i;
+
+	unlink(bench_drv_path(BENCH_DRV_REGVAL));
+	unlink(bench_drv_path(BENCH_DRV_REGIDX));
+	unlink(bench_drv_path(BENCH_DRV_DRIVER));
+	for (i = ARRAY_SIZE(bench_drv_dirs) - 1; i >= 0; --i)
+		rmdir(bench_drv_path(bench_drv_dirs[i]));
+	rmdir(bench_drv_dir);
+}
+
+static int bench_drv_run(void)
+{
+	struct atheepmgr aem;
+	unsigned long i;
+	int ret = -1;
+	uint32_t val;
+	double t;
+
+	memset(&aem, 0x00, sizeof(aem));
+	aem.con = &con_driver;
+
+	if (!mkdtemp(bench_drv_dir)) {
+		fprintf(stderr, "bench: unable to create temporary directory: %s\n",
+			strerror(errno));
+		return -1;
+	}
+
+	if (bench_drv_tree_create()) {
+		fprintf(stderr, "bench: unable to create fake debugfs tree: %s\n",
+			strerror(errno));
+		goto out;
+	}
+
+	setenv("ATHEEPMGR_SYSFS_ROOT", bench_drv_path("/sys"), 1);
+	setenv("ATHEEPMGR_DEBUGFS_ROOT", bench_drv_path("/dbg"), 1);
+
+	aem.con_priv = malloc(con_driver.priv_data_sz);
+	if (!aem.con_priv || con_driver.init(&aem, "phy0")) {
+		fprintf(stderr, "bench: unable to init driver connector\n");
+		goto out;
+	}
+
+	t = bench_now();
+	for (i = 0; i < BENCH_DRV_ITERS; ++i)
+		if (bench_drv_reg_read_stdio(0x407c, &val) || val != 0x12345678)
+			goto err_io;
+	bench_report("reg read, reopen + stdio", i, bench_now() - t);
+
+	t = bench_now();
+	for (i = 0; i < BENCH_DRV_ITERS; ++i)
+		if (con_driver.reg_read(&aem, 0x407c) != 0x12345678)
+			goto err_io;
+	bench_report("reg read, driver connector", i, bench_now() - t);
+
+	ret = 0;
+	goto con_clean;
+
+err_io:
+	fprintf(stderr, "bench: register read failed\n");
+
+con_clean:
+	con_driver.clean(&aem);
+
+out:
+	free(aem.con_priv);
+	bench_drv_tree_remove();
+
+	return ret;
+}
+#endif	/* CONFIG_CON_DRIVER */
+
+/**
+ * AR9300 compressed data reversed bytestream extraction: the former per-byte
+ * loop vs. the whole buffer reversal. AR9300 and QCA9880 templates are used
+ * as the source data, each one is extracted starting from its end.
+ */
+
+#define BENCH_BSTR_ITERS	20000
+
+static void bench_bstr_bytes(const uint16_t *buf, bool buf_is_be, int addr,
+			     uint8_t *buffer, int count)
+{
+	int i;
+
+	for (i = addr; i > addr - count; --i) {
+		int shift_bytes = buf_is_be ? (i + 1) % 2 : i % 2;
+
+		buffer[addr - i] = buf[i / 2] >> (8 * shift_bytes);
+	}
+}
+
+static int bench_bstr_run(void)
+{
+#define BENCH_TPL(__tpl)	{ #__tpl, &__tpl, sizeof(__tpl) }
+	static const struct {
+		const char *name;
+		const void *data;
+		int len;
+	} tpls[] = {
+		BENCH_TPL(ar9300_default),
+		BENCH_TPL(ar9300_h112),
+		BENCH_TPL(ar9300_h116),
+		BENCH_TPL(ar9300_x112),
+		BENCH_TPL(ar9300_x113),
+		BENCH_TPL(qca9880_generic),
+		BENCH_TPL(qca9880_cus223),
+		BENCH_TPL(qca9880_xb140),
+	};
+	static uint16_t buf[sizeof(struct qca9880_eeprom) / 2 + 1];
+	static uint8_t out1[sizeof(buf)], out2[sizeof(buf)];
+	bool host_is_be = __BYTE_ORDER == __BIG_ENDIAN;
+	char what[0x40];
+	unsigned long i;
+	int j, len;
+	double t;
+
+	for (j = 0; j < ARRAY_SIZE(tpls); ++j) {
+		len = tpls[j].len;
+		if (len > sizeof(buf)) {
+			fprintf(stderr, "bench: %s template is too big\n",
+				tpls[j].name);
+			return -1;
+		}
+		memcpy(buf, tpls[j].data, len);
+
+		snprintf(what, sizeof(what), "%s, bytes", tpls[j].name);
+		t = bench_now();
+		for (i = 0; i < BENCH_BSTR_ITERS; ++i)
+			bench_bstr_bytes(buf, host_is_be, len - 1, out1, len);
+		bench_report(what, i, bench_now() - t);
+
+		snprintf(what, sizeof(what), "%s, reverse", tpls[j].name);
+		t = bench_now();
+		for (i = 0; i < BENCH_BSTR_ITERS; ++i)
+			memcpy_rev(out2, buf, len);
+		bench_report(what, i, bench_now() - t);
+
+		if (memcmp(out1, out2, len) != 0) {
+			fprintf(stderr, "bench: %s template extraction mismatch\n",
+				tpls[j].name);
+			return -1;
+		}
+	}
+
+	return 0;
+
+#undef BENCH_TPL
+}
+
+/**
+ * AR9300 compressed blocks decoding: pairs and LZMA blocks are synthesized
+ * from the templates. Pairs blocks contain the difference against another
+ * template, LZMA blocks contain the whole template data. To synthesize LZMA
+ * blocks, a tiny encoder is used, which produces only literals and the
+ * previous byte repeats. Matches, all the rep distances and the end marker
+ * are exercised by a fixed vector, produced by the real LZMA encoder.
+ */
+
+#define BENCH_COMP_ITERS	5000
+
+struct bench_lzma_enc {
+	uint8_t *out;
+	int pos;
+	int size;
+	uint64_t low;
+	uint32_t range;
+	uint8_t cache;
+	int cache_size;
+	uint16_t is_match[12 << 4];
+	uint16_t is_rep[12];
+	uint16_t is_rep_g0[12];
+	uint16_t is_rep0_long[12 << 4];
+	uint16_t choice, choice2;
+	uint16_t low_len[1 << 4][1 << 3];
+	uint16_t mid_len[1 << 4][1 << 3];
+	uint16_t high_len[1 << 8];
+	uint16_t literal[0x300 << 3];
+};
+
+static void bench_lzma_shift_low(struct bench_lzma_enc *e)
+{
+	uint8_t tmp;
+
+	if ((uint32_t)e->low < 0xff000000 || (e->low >> 32) != 0) {
+		tmp = e->cache;
+		do {
+			if (e->pos < e->size)
+				e->out[e->pos] = tmp + (uint8_t)(e->low >> 32);
+			e->pos++;
+			tmp = 0xff;
+		} while (--e->cache_size != 0);
+		e->cache = (uint32_t)e->low >> 24;
+	}
+	e->cache_size++;
+	e->low = (uint32_t)e->low << 8;
+}
+
+static void bench_lzma_bit(struct bench_lzma_enc *e, uint16_t *prob,
+			   unsigned bit)
+{
+	uint32_t bound = (e->range >> 11) * *prob;
+
+	if (!bit) {
+		e->range = bound;
+		*prob += (2048 - *prob) >> 5;
+	} else {
+		e->low += bound;
+		e->range -= bound;
+		*prob -= *prob >> 5;
+	}
+	while (e->range < (1U << 24)) {
+		e->range <<= 8;
+		bench_lzma_shift_low(e);
+	}
+}
+
+static void bench_lzma_bittree(struct bench_lzma_enc *e, uint16_t *probs,
+			       unsigned nbits, unsigned sym)
+{
+	unsigned m = 1, bit;
+
+	while (nbits--) {
+		bit = (sym >> nbits) & 1;
+		bench_lzma_bit(e, &probs[m], bit);
+		m = (m << 1) | bit;
+	}
+}
+
+/* Encode the data with lc=3, lp=0, pb=0, returns the encoded length */
+static int bench_lzma_encode(uint8_t *out, int size, const uint8_t *data,
+			     int len)
+{
+	static struct bench_lzma_enc e;
+	unsigned state = 0, sym, bit, mbit, mbyte;
+	uint16_t *probs, *p;
+	int pos, run, i;
+
+	memset(&e, 0x00, sizeof(e));
+	for (p = e.is_match; p < e.literal + ARRAY_SIZE(e.literal); ++p)
+		*p = 1024;
+	e.out = out;
+	e.pos = LZMA_HDR_LEN;
+	e.size = size;
+	e.range = 0xffffffff;
+	e.cache_size = 1;
+
+	out[0] = 3;				/* lc=3, lp=0, pb=0 */
+	for (i = 0; i < 4; ++i)
+		out[1 + i] = (0x1000 >> (8 * i)) & 0xff;
+	for (i = 0; i < 8; ++i)
+		out[5 + i] = i < 4 ? (len >> (8 * i)) & 0xff : 0;
+
+	for (pos = 0; pos < len; pos += run) {
+		for (run = 0; pos && pos + run < len && run < 273 &&
+			      data[pos + run] == data[pos - 1]; ++run)
+			;
+		if (run) {
+			bench_lzma_bit(&e, &e.is_match[state << 4], 1);
+			bench_lzma_bit(&e, &e.is_rep[state], 1);
+			bench_lzma_bit(&e, &e.is_rep_g0[state], 0);
+			bench_lzma_bit(&e, &e.is_rep0_long[state << 4],
+				       run > 1);
+			if (run == 1) {
+				state = state < 7 ? 9 : 11;
+				continue;
+			}
+			run -= 2;
+			if (run < 8) {
+				bench_lzma_bit(&e, &e.choice, 0);
+				bench_lzma_bittree(&e, e.low_len[0], 3, run);
+			} else if (run < 16) {
+				bench_lzma_bit(&e, &e.choice, 1);
+				bench_lzma_bit(&e, &e.choice2, 0);
+				bench_lzma_bittree(&e, e.mid_len[0], 3, run - 8);
+			} else {
+				bench_lzma_bit(&e, &e.choice, 1);
+				bench_lzma_bit(&e, &e.choice2, 1);
+				bench_lzma_bittree(&e, e.high_len, 8, run - 16);
+			}
+			run += 2;
+			state = state < 7 ? 8 : 11;
+			continue;
+		}
+
+		bench_lzma_bit(&e, &e.is_match[state << 4], 0);
+		probs = &e.literal[0x300 * (pos ? data[pos - 1] >> 5 : 0)];
+		sym = 1;
+		i = 8;
+		if (state >= 7) {
+			mbyte = data[pos - 1];	/* rep0 is always 0 */
+			do {
+				--i;
+				bit = (data[pos] >> i) & 1;
+				mbit = (mbyte >> i) & 1;
+				bench_lzma_bit(&e, &probs[((1 + mbit) << 8) +
+							  sym], bit);
+				sym = (sym << 1) | bit;
+			} while (mbit == bit && i);
+		}
+		while (i--) {
+			bit = (data[pos] >> i) & 1;
+			bench_lzma_bit(&e, &probs[sym], bit);
+			sym = (sym << 1) | bit;
+		}
+		state = state < 4 ? 0 : state < 10 ? state - 3 : state - 6;
+		run = 1;
+	}
+
+	for (i = 0; i < 5; ++i)
+		bench_lzma_shift_low(&e);
+
+	return e.pos <= size ? e.pos : -1;
+}
+
+/* Encode differing bytes as (offset, value) pairs */
+static int bench_pairs_encode(uint8_t *out, int size, const uint8_t *data,
+			      const uint8_t *ref, int len)
+{
+	int pos = 0, spot = 0, i;
+
+	for (i = 0; i < len; ++i) {
+		if (data[i] == ref[i] && i - spot < 0xff)
+			continue;
+		if (pos + 2 > size)
+			return -1;
+		out[pos++] = i - spot;
+		out[pos++] = data[i];
+		spot = i + 1;
+	}
+
+	return pos;
+}
+
+static const struct ar9300_eeprom *bench_comp_tpls[] = {
+	&ar9300_default, &ar9300_h112, &ar9300_h116, &ar9300_x112,
+	&ar9300_x113,
+};
+
+static const uint8_t *bench_comp_tpl_lookup(int id)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(bench_comp_tpls); ++i)
+		if (bench_comp_tpls[i]->templateVersion == id)
+			return (const uint8_t *)bench_comp_tpls[i];
+
+	return NULL;
+}
+
+static int bench_comp_decode(struct atheepmgr *aem, int comp, int ref,
+			     const uint8_t *data, int len, const void *expect,
+			     const char *what)
+{
+	const int size = sizeof(struct ar9300_eeprom);
+	struct ar9300_comp_hdr hdr = {comp, ref, len, 0, 0};
+	uint8_t out[sizeof(struct ar9300_eeprom)];
+	unsigned long i;
+	int currref;
+	double t;
+
+	t = bench_now();
+	for (i = 0; i < BENCH_COMP_ITERS; ++i) {
+		currref = -1;
+		if (ar9300_compress_decision(aem, 0, &hdr, out, data, size,
+					     &currref, bench_comp_tpl_lookup))
+			break;
+	}
+	t = bench_now() - t;
+	if (i != BENCH_COMP_ITERS || memcmp(out, expect, size) != 0) {
+		fprintf(stderr, "bench: %s decoding failed\n", what);
+		return -1;
+	}
+	bench_report(what, i, t);
+
+	return 0;
+}
+
+/**
+ * Python lzma.compress(data, format=lzma.FORMAT_ALONE) output, which has an
+ * unknown unpacked size, so the stream is terminated by the end marker. The
+ * data are generated by bench_lzma_vec_data().
+ */
+static const uint8_t bench_lzma_vec[] = {
+	0x5d, 0x00, 0x00, 0x80, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x00, 0x2a, 0xaa, 0xa4, 0x02, 0x61, 0x3a, 0x1a, 0x61, 0x75, 0xbb,
+	0xaf, 0xd6, 0x5b, 0x94, 0xc0, 0x4f, 0xae, 0x78, 0x02, 0x59, 0xda, 0x7c,
+	0xa7, 0xf5, 0xa3, 0x0e, 0x01, 0xa5, 0x40, 0xf4, 0xa1, 0xe7, 0xd8, 0x4b,
+	0x78, 0x36, 0xb8, 0x5d, 0xf5, 0x2f, 0x34, 0x12, 0x71, 0xf2, 0x9d, 0x89,
+	0x81, 0xf9, 0xbf, 0xfa, 0x6b, 0xc8, 0xea, 0xb9, 0xfe, 0xed, 0x8f, 0x3a,
+	0x62, 0x58, 0xc9, 0xe4, 0xc9, 0xdf, 0xed, 0x64, 0x99, 0x10, 0x9d, 0xcb,
+	0x67, 0x20, 0x57, 0x2f, 0x4f, 0x68, 0x12, 0x15, 0x52, 0x12, 0xfb, 0x4a,
+	0xdf, 0x7e, 0xc5, 0x5e, 0xc9, 0xa6, 0x71, 0xd7, 0x9d, 0x52, 0xa7, 0x4b,
+	0xe4, 0x21, 0x62, 0x28, 0xb1, 0x06, 0x2e, 0xfa, 0xff, 0x6f, 0x66, 0x65,
+	0x08, 0xbc, 0x33, 0xe7, 0xfb, 0xa5, 0x4b, 0x21, 0x88, 0xaf, 0x40, 0x63,
+	0xd6, 0x96, 0xcb, 0x3a, 0x3b, 0x3f, 0xf7, 0x6d, 0xdb, 0x8d, 0x06, 0x0f,
+	0xc1, 0xa9, 0x65, 0x71, 0x9a, 0xb0, 0x11, 0xcd, 0xb2, 0xe5, 0x5f, 0x81,
+	0x88, 0x8b, 0x28, 0x91, 0xb4, 0xf3, 0x3f, 0x73, 0x61, 0xde, 0xd2, 0x62,
+	0xec, 0xb6, 0xe4, 0xf6, 0x95, 0x38, 0xef, 0x0d, 0x04, 0xbe, 0xe0, 0x31,
+	0xf8, 0x09, 0x8e, 0x85, 0x4d, 0x83, 0x04, 0xe8, 0x49, 0xe6, 0xeb, 0xdd,
+	0x0f, 0xf5, 0xf3, 0x56, 0x2d, 0x18, 0xca, 0xf6, 0xcf, 0x98, 0x00, 0xaa,
+	0xfe, 0xe6, 0x17, 0x04, 0x15, 0x01, 0x0d, 0x86, 0x42, 0x37, 0xe5, 0x3c,
+	0xe1, 0xa1, 0xe5, 0x28, 0x54, 0x44, 0xb5, 0xfc, 0xad, 0x4b, 0xf8, 0xe1,
+	0x72, 0xc7, 0x7f, 0xff, 0xd2, 0xb7, 0x0d, 0x0f,
+};
+
+static int bench_lzma_vec_data(uint8_t *buf)
+{
+	static const char * const words[] = {
+		"ath5k ", "ath9k ", "ath9k_htc ", "ath10k_pci ", "ath10k_ahb ",
+		"ath11k ", "\x55\xaa\x55\xaa\x55\xaa",
+		"\x12\x34\x56\x12\x34\x56\x12",
+	};
+	const char *word;
+	uint32_t x = 1;
+	int i, n, len = 0;
+
+	for (i = 0; i < 120; ++i) {
+		x = (x * 1103515245 + 12345) & 0x7fffffff;
+		word = words[(x >> 16) % ARRAY_SIZE(words)];
+		n = strlen(word);
+		memcpy(&buf[len], word, n);
+		len += n;
+		if ((x >> 8) % 5 == 0) {
+			n = (x >> 4) % 9 + 1;
+			memset(&buf[len], 0x00, n);
+			len += n;
+		}
+	}
+
+	return len;
+}
+
+static int bench_lzma_vec_run(void)
+{
+	uint8_t out[0x800], expect[0x800];
+	unsigned long i;
+	char what[0x40];
+	int len;
+	double t;
+
+	len = bench_lzma_vec_data(expect);
+
+	t = bench_now();
+	for (i = 0; i < BENCH_COMP_ITERS; ++i)
+		if (lzma_decode(out, sizeof(out), bench_lzma_vec,
+				sizeof(bench_lzma_vec)) != len)
+			break;
+	t = bench_now() - t;
+	snprintf(what, sizeof(what), "fixed vector, lzma %zu B",
+		 sizeof(bench_lzma_vec));
+	if (i != BENCH_COMP_ITERS || memcmp(out, expect, len) != 0) {
+		fprintf(stderr, "bench: %s decoding failed\n", what);
+		return -1;
+	}
+	bench_report(what, i, t);
+
+	return 0;
+}
+
+static int bench_comp_run(void)
+{
+	const int size = sizeof(struct ar9300_eeprom);
+	static const char * const names[] = {"default", "h112", "h116",
+					     "x112", "x113"};
+	struct atheepmgr aem = {0};
+	const struct ar9300_eeprom *tpl, *ref;
+	uint8_t blk[AR9300_EEPROM_SIZE];
+	char what[0x40];
+	int i, len;
+
+	for (i = 0; i < ARRAY_SIZE(bench_comp_tpls); ++i) {
+		tpl = bench_comp_tpls[i];
+		ref = bench_comp_tpls[i ? 0 : 1];
+
+		len = bench_pairs_encode(blk, sizeof(blk), (uint8_t *)tpl,
+					 (uint8_t *)ref, size);
+		snprintf(what, sizeof(what), "%s, pairs %d B", names[i], len);
+		if (len < 0 ||
+		    bench_comp_decode(&aem, AR9300_COMP_PAIRS,
+				      ref->templateVersion, blk, len, tpl,
+				      what))
+			return -1;
+
+		len = bench_lzma_encode(blk, sizeof(blk), (uint8_t *)tpl, size);
+		snprintf(what, sizeof(what), "%s, lzma %d B", names[i], len);
+		if (len < 0 ||
+		    bench_comp_decode(&aem, AR9300_COMP_LZMA, 0, blk, len, tpl,
+				      what))
+			return -1;
+	}
+
+	return bench_lzma_vec_run();
+}
+
+static const struct bench benches[] = {
+#ifdef CONFIG_CON_DRIVER
+	{"driver", "Driver connector register access", bench_drv_run},
+#endif
+	{"bstr", "AR9300 reversed bytestream extraction", bench_bstr_run},
+	{"comp", "AR9300 pairs and LZMA blocks decoding", bench_comp_run},
+};
+
+int main(int argc, char *argv[])
+{
+	int i, j, ret = EXIT_SUCCESS;
+
+	for (i = 0; i < ARRAY_SIZE(benches); ++i) {
+		for (j = 1; j < argc; ++j)
+			if (strcmp(argv[j], benches[i].name) == 0)
+				break;
+		if (argc > 1 && j == argc)
+			continue;
+		printf("%s: %s\n", benches[i].name, benches[i].desc);
+		if (benches[i].run())
+			ret = EXIT_FAILURE;
+	}
+
+	return ret;
+}
@@ -15,22 +15,32 @@
  */
 
 #include <unistd.h>
+#include <fcntl.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include "atheepmgr.h"
 
-#define SYSFS_NETDEV_PATH "/sys/class/net"
-#define SYSFS_CFG80211_PATH "/sys/class/ieee80211"
-#define DEBUGFS_PATH "/sys/kernel/debug"
-#define DEBUGFS_CFG80211_PATH DEBUGFS_PATH "/ieee80211"
+/* Roots could be overridden via the environment, e.g. for testing purposes */
+#define SYSFS_ROOT_ENV "ATHEEPMGR_SYSFS_ROOT"
+#define SYSFS_ROOT "/sys"
+#define DEBUGFS_ROOT_ENV "ATHEEPMGR_DEBUGFS_ROOT"
+#define DEBUGFS_ROOT "/sys/kernel/debug"
+
+#define SYSFS_NETDEV_PATH "/class/net"
+#define SYSFS_CFG80211_PATH "/class/ieee80211"
+#define DEBUGFS_CFG80211_PATH "/ieee80211"
 
 struct driver_priv {
-	char *regidx_fname;
-	char *regval_fname;
-	const char *regval_fmt;
+	int regidx_fd;
+	int regval_fd;
+	int regval_off;
 	int regval_strlen;
+	char *blob_fname;	/* Raw data file path, NULL if not supported */
+	bool blob_loaded;
+	uint8_t *blob_buf;	/* Raw data contents */
+	int blob_len;
 };
 
 static const char * const driver_ath9k_names[] = {
@@ -50,8 +60,9 @@ static const struct driver_info {
 	struct {
 		const char * const regidx_fname;
 		const char * const regval_fname;
-		const char * const regval_fmt;
+		int regval_off;		/* Value offset within the string */
 		int regval_strlen;
+		const char * const blob_fname;	/* Raw data file, optional */
 	} debugfs;
 } driver_infos[] = {
 	{
@@ -60,7 +71,7 @@ static const struct driver_info {
 		.debugfs = {
 			.regidx_fname = "regidx",
 			.regval_fname = "regval",
-			.regval_fmt = "0x%8x%n",
+			.regval_off = 2,	/* 0x%08x */
 			.regval_strlen = 10,
 		},
 	}, {
@@ -69,29 +80,67 @@ static const struct driver_info {
 		.debugfs = {
 			.regidx_fname = "reg_addr",
 			.regval_fname = "reg_value",
-			.regval_fmt = "0x%*8x:0x%8x%n",
+			.regval_off = 13,	/* 0x%08x:0x%08x */
 			.regval_strlen = 21,
+			.blob_fname = "cal_data",
 		},
 	}
 };
 
-static int __regidx_write(struct atheepmgr *aem, uint32_t reg)
+/**
+ * Register access is performed for each EEPROM word and each status poll, so
+ * avoid the stdio overhead and format/parse the debugfs strings manually.
+ */
+static const char __hexdigits[] = "0123456789abcdef";
+
+static int __hex32_fmt(char *buf, uint32_t val)
 {
-	struct driver_priv *dpd = aem->con_priv;
-	FILE *fp = fopen(dpd->regidx_fname, "w");
+	int i;
 
-	if (!fp) {
-		fprintf(stderr, "condriver: unable to open %s for writing: %s\n",
-			dpd->regidx_fname, strerror(errno));
+	buf[0] = '0';
+	buf[1] = 'x';
+	for (i = 0; i < 8; ++i)
+		buf[2 + i] = __hexdigits[(val >> (28 - i * 4)) & 0xf];
+	buf[10] = '\n';
+
+	return 11;
+}
+
+static int __hex32_parse(const char *buf, uint32_t *pval)
+{
+	uint32_t val = 0;
+	int i, d;
+
+	if (buf[0] != '0' || (buf[1] != 'x' && buf[1] != 'X'))
 		return -1;
+
+	for (i = 2; i < 10; ++i) {
+		if (buf[i] >= '0' && buf[i] <= '9')
+			d = buf[i] - '0';
+		else if (buf[i] >= 'a' && buf[i] <= 'f')
+			d = buf[i] - 'a' + 10;
+		else if (buf[i] >= 'A' && buf[i] <= 'F')
+			d = buf[i] - 'A' + 10;
+		else
+			return -1;
+		val = val << 4 | d;
 	}
-	if (fprintf(fp, "0x%08x\n", reg) != 11) {
+	*pval = val;
+
+	return 0;
+}
+
+static int __regidx_write(struct atheepmgr *aem, uint32_t reg)
+{
+	struct driver_priv *dpd = aem->con_priv;
+	char buf[11];
+	int len = __hex32_fmt(buf, reg);
+
+	if (pwrite(dpd->regidx_fd, buf, len, 0) != len) {
 		fprintf(stderr, "condriver: unable to write register address: %s\n",
 			strerror(errno));
-		fclose(fp);
 		return -1;
 	}
-	fclose(fp);
 
 	return 0;
 }
@@ -99,28 +148,24 @@ static int __regidx_write(struct atheepmgr *aem, uint32_t reg)
 static int __regval_read(struct atheepmgr *aem, uint32_t *pval)
 {
 	struct driver_priv *dpd = aem->con_priv;
-	FILE *fp = fopen(dpd->regval_fname, "r");
-	unsigned int v;
-	int n, l;
+	uint32_t addr;
+	char buf[0x20];
+	ssize_t res;
 
-	if (!fp) {
-		fprintf(stderr, "condriver: unable to open %s for reading: %s\n",
-			dpd->regval_fname, strerror(errno));
-		return -1;
-	}
-	n = fscanf(fp, dpd->regval_fmt, &v, &l);
-	if (ferror(fp)) {
+	res = pread(dpd->regval_fd, buf, sizeof(buf), 0);
+	if (res < 0) {
 		fprintf(stderr, "condriver: unable to read register value file: %s\n",
 			strerror(errno));
-		fclose(fp);
 		return -1;
 	}
-	fclose(fp);
-	if (n != 1 || l != dpd->regval_strlen) {
+	if (res < dpd->regval_strlen ||
+	    (res > dpd->regval_strlen && buf[dpd->regval_strlen] != '\n') ||
+	    (dpd->regval_off > 2 &&	/* Value is prefixed with "0x%08x:" */
+	     (__hex32_parse(buf, &addr) || buf[dpd->regval_off - 3] != ':')) ||
+	    __hex32_parse(buf + dpd->regval_off - 2, pval)) {
 		fprintf(stderr, "condriver: unexpected register value format\n");
 		return -1;
 	}
-	*pval = v;
 
 	return 0;
 }
@@ -128,20 +173,14 @@ static int __regval_read(struct atheepmgr *aem, uint32_t *pval)
 static int __regval_write(struct atheepmgr *aem, uint32_t val)
 {
 	struct driver_priv *dpd = aem->con_priv;
-	FILE *fp = fopen(dpd->regval_fname, "w");
+	char buf[11];
+	int len = __hex32_fmt(buf, val);
 
-	if (!fp) {
-		fprintf(stderr, "condriver: unable to open %s for writing: %s\n",
-			dpd->regval_fname, strerror(errno));
-		return -1;
-	}
-	if (fprintf(fp, "0x%08x\n", val) != 11) {
+	if (pwrite(dpd->regval_fd, buf, len, 0) != len) {
 		fprintf(stderr, "condriver: unable to write register value: %s\n",
 			strerror(errno));
-		fclose(fp);
 		return -1;
 	}
-	fclose(fp);
 
 	return 0;
 }
@@ -184,14 +223,127 @@ static void driver_reg_rmw(struct atheepmgr *aem, uint32_t reg, uint32_t set,
 	__regval_write(aem, value);
 }
 
+/**
+ * Debugfs interface could not transfer several registers at once, but at
+ * least stop on the first failure instead of hammering the broken interface
+ * with a syscall pair per each register of the range.
+ */
+static void driver_reg_read_bulk(struct atheepmgr *aem, uint32_t reg,
+				 uint32_t *buf, unsigned int cnt)
+{
+	for (; cnt; --cnt, ++buf, reg += sizeof(uint32_t)) {
+		if (__regidx_write(aem, reg) || __regval_read(aem, buf))
+			break;
+	}
+	memset(buf, 0x00, cnt * sizeof(*buf));
+}
+
+static void driver_reg_write_bulk(struct atheepmgr *aem, uint32_t reg,
+				  const uint32_t *buf, unsigned int cnt)
+{
+	for (; cnt; --cnt, ++buf, reg += sizeof(uint32_t)) {
+		if (__regidx_write(aem, reg) || __regval_write(aem, *buf))
+			break;
+	}
+}
+
+/**
+ * Load the whole raw data file at once, since the driver could generate its
+ * contents on each file opening (e.g. by fetching them from the chip memory).
+ * Absence or unreadability of the file is not an error, it just means that
+ * the data should be fetched via the register level access.
+ */
+static void driver_blob_load(struct atheepmgr *aem)
+{
+	struct driver_priv *dpd = aem->con_priv;
+	uint8_t *buf;
+	ssize_t res;
+	int fd, sz;
+
+	dpd->blob_loaded = true;
+
+	if (!dpd->blob_fname)
+		return;
+
+	fd = open(dpd->blob_fname, O_RDONLY);
+	if (fd < 0) {
+		if (aem->verbose > 1)
+			printf("condriver: unable to open %s: %s\n",
+			       dpd->blob_fname, strerror(errno));
+		return;
+	}
+
+	for (sz = 0;;) {
+		if (dpd->blob_len == sz) {
+			sz += 0x1000;
+			buf = realloc(dpd->blob_buf, sz);
+			if (!buf) {
+				fprintf(stderr, "condriver: unable to allocate memory for raw data\n");
+				goto err;
+			}
+			dpd->blob_buf = buf;
+		}
+		res = read(fd, dpd->blob_buf + dpd->blob_len,
+			   sz - dpd->blob_len);
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res < 0) {
+			if (aem->verbose > 1)
+				printf("condriver: unable to read %s: %s\n",
+				       dpd->blob_fname, strerror(errno));
+			goto err;
+		}
+		if (res == 0)
+			break;
+		dpd->blob_len += res;
+	}
+
+	close(fd);
+
+	if (aem->verbose)
+		printf("condriver: fetched %d bytes of raw data from %s\n",
+		       dpd->blob_len, dpd->blob_fname);
+
+	return;
+
+err:
+	close(fd);
+	dpd->blob_len = 0;
+}
+
+static int driver_blob_getsize(struct atheepmgr *aem)
+{
+	struct driver_priv *dpd = aem->con_priv;
+
+	if (!dpd->blob_loaded)
+		driver_blob_load(aem);
+
+	return dpd->blob_len;
+}
+
+static int driver_blob_read(struct atheepmgr *aem, void *buf, int len)
+{
+	struct driver_priv *dpd = aem->con_priv;
+
+	if (!dpd->blob_loaded)
+		driver_blob_load(aem);
+
+	if (len > dpd->blob_len)
+		len = dpd->blob_len;
+	memcpy(buf, dpd->blob_buf, len);
+
+	return len;
+}
+
 #define STATERRMSG(__path)						\
 	fprintf(stderr, "condriver: unable to stat %s: %s\n", __path,	\
 		strerror(errno))
 
-#define TEST_DIR(__dirname, __noentmsg)					\
+#define TEST_DIR(__root, __dirname, __noentmsg)				\
 	do {								\
-		if (stat(__dirname, &statbuf)) {			\
-			STATERRMSG(__dirname);				\
+		snprintf(pbuf, sizeof(pbuf), "%s%s", __root, __dirname);\
+		if (stat(pbuf, &statbuf)) {				\
+			STATERRMSG(pbuf);				\
 			if (__noentmsg && errno == ENOENT)		\
 				fprintf(stderr, "condriver: %s\n", __noentmsg);\
 			goto err_dir;					\
@@ -203,15 +355,31 @@ static int driver_init(struct atheepmgr *aem, const char *arg_str)
 	char *p, pbuf[0x100], phyname[0x20], drivername[0x40];
 	struct driver_priv *dpd = aem->con_priv;
 	const struct driver_info *di;
+	const char *sysfs, *debugfs;
 	struct stat statbuf;
 	int i, j, res;
 
-	TEST_DIR(DEBUGFS_PATH, "has the DebugFS been mounted?");
-	TEST_DIR(SYSFS_CFG80211_PATH, "has cfg80211 module been loaded?");
-	TEST_DIR(DEBUGFS_CFG80211_PATH,
+	dpd->regidx_fd = -1;
+	dpd->regval_fd = -1;
+	dpd->blob_fname = NULL;
+	dpd->blob_loaded = false;
+	dpd->blob_buf = NULL;
+	dpd->blob_len = 0;
+
+	sysfs = getenv(SYSFS_ROOT_ENV);
+	if (!sysfs)
+		sysfs = SYSFS_ROOT;
+	debugfs = getenv(DEBUGFS_ROOT_ENV);
+	if (!debugfs)
+		debugfs = DEBUGFS_ROOT;
+
+	TEST_DIR(debugfs, "", "has the DebugFS been mounted?");
+	TEST_DIR(sysfs, SYSFS_CFG80211_PATH, "has cfg80211 module been loaded?");
+	TEST_DIR(debugfs, DEBUGFS_CFG80211_PATH,
 		 "has cfg80211 been built with the debugfs support?");
 
-	snprintf(pbuf, sizeof(pbuf), SYSFS_NETDEV_PATH "/%s", arg_str);
+	snprintf(pbuf, sizeof(pbuf), "%s" SYSFS_NETDEV_PATH "/%s", sysfs,
+		 arg_str);
 	if (stat(pbuf, &statbuf)) {
 		if (errno == ENOENT) {
 			strncpy(phyname, arg_str, sizeof(phyname));
@@ -222,7 +390,8 @@ static int driver_init(struct atheepmgr *aem, const char *arg_str)
 		return -1;
 	}
 
-	snprintf(pbuf, sizeof(pbuf), SYSFS_NETDEV_PATH "/%s/phy80211", arg_str);
+	snprintf(pbuf, sizeof(pbuf), "%s" SYSFS_NETDEV_PATH "/%s/phy80211",
+		 sysfs, arg_str);
 	res = readlink(pbuf, phyname, sizeof(phyname));
 	if (res < 0) {
 		fprintf(stderr, "condriver: unable to read phy path from %s: %s\n",
@@ -243,7 +412,8 @@ static int driver_init(struct atheepmgr *aem, const char *arg_str)
 	memmove(phyname, p + 1, res - (p - phyname));
 
 skip_netdev:
-	snprintf(pbuf, sizeof(pbuf), SYSFS_CFG80211_PATH"/%s", phyname);
+	snprintf(pbuf, sizeof(pbuf), "%s" SYSFS_CFG80211_PATH "/%s", sysfs,
+		 phyname);
 	if (stat(pbuf, &statbuf)) {
 		if (errno == ENOENT)
 			fprintf(stderr, "condriver: no such IEEE 802.11 phy -- %s\n",
@@ -253,7 +423,8 @@ skip_netdev:
 		return -1;
 	}
 
-	snprintf(pbuf, sizeof(pbuf), SYSFS_CFG80211_PATH"/%s/device/driver", phyname);
+	snprintf(pbuf, sizeof(pbuf), "%s" SYSFS_CFG80211_PATH "/%s/device/driver",
+		 sysfs, phyname);
 	res = readlink(pbuf, drivername, sizeof(drivername));
 	if (res < 0) {
 		fprintf(stderr, "condriver: unable to read phy driver name from %s: %s\n",
@@ -288,8 +459,8 @@ skip_netdev:
 		return -1;
 	}
 
-	snprintf(pbuf, sizeof(pbuf), DEBUGFS_CFG80211_PATH"/%s/%s/%s",
-		 phyname, di->name, di->debugfs.regidx_fname);
+	snprintf(pbuf, sizeof(pbuf), "%s" DEBUGFS_CFG80211_PATH "/%s/%s/%s",
+		 debugfs, phyname, di->name, di->debugfs.regidx_fname);
 	if (stat(pbuf, &statbuf)) {
 		STATERRMSG(pbuf);
 		if (errno == ENOENT)
@@ -297,14 +468,15 @@ skip_netdev:
 				di->name);
 		goto err;
 	}
-	dpd->regidx_fname = strdup(pbuf);
-	if (!dpd->regidx_fname) {
-		fprintf(stderr, "condriver: unable to allocate memory for register address file path\n");
+	dpd->regidx_fd = open(pbuf, O_WRONLY);
+	if (dpd->regidx_fd < 0) {
+		fprintf(stderr, "condriver: unable to open %s for writing: %s\n",
+			pbuf, strerror(errno));
 		goto err;
 	}
 
-	snprintf(pbuf, sizeof(pbuf), DEBUGFS_CFG80211_PATH"/%s/%s/%s",
-		 phyname, di->name, di->debugfs.regval_fname);
+	snprintf(pbuf, sizeof(pbuf), "%s" DEBUGFS_CFG80211_PATH "/%s/%s/%s",
+		 debugfs, phyname, di->name, di->debugfs.regval_fname);
 	if (stat(pbuf, &statbuf)) {
 		STATERRMSG(pbuf);
 		if (errno == ENOENT)
@@ -312,20 +484,33 @@ skip_netdev:
 				di->name);
 		goto err;
 	}
-	dpd->regval_fname = strdup(pbuf);
-	if (!dpd->regval_fname) {
-		fprintf(stderr, "condriver: unable to allocate memory for register value file path\n");
+	dpd->regval_fd = open(pbuf, O_RDWR);
+	if (dpd->regval_fd < 0) {
+		fprintf(stderr, "condriver: unable to open %s for reading and writing: %s\n",
+			pbuf, strerror(errno));
 		goto err;
 	}
 
-	dpd->regval_fmt = di->debugfs.regval_fmt;
+	dpd->regval_off = di->debugfs.regval_off;
 	dpd->regval_strlen = di->debugfs.regval_strlen;
 
+	if (di->debugfs.blob_fname) {
+		snprintf(pbuf, sizeof(pbuf), "%s" DEBUGFS_CFG80211_PATH "/%s/%s/%s",
+			 debugfs, phyname, di->name, di->debugfs.blob_fname);
+		dpd->blob_fname = strdup(pbuf);
+		if (!dpd->blob_fname) {
+			fprintf(stderr, "condriver: unable to allocate memory for raw data file path\n");
+			goto err;
+		}
+	}
+
 	return 0;
 
 err:
-	free(dpd->regidx_fname);
-	free(dpd->regval_fname);
+	if (dpd->regidx_fd >= 0)
+		close(dpd->regidx_fd);
+	if (dpd->regval_fd >= 0)
+		close(dpd->regval_fd);
 
 err_dir:
 	return -1;
@@ -335,17 +520,28 @@ static void driver_clean(struct atheepmgr *aem)
 {
 	struct driver_priv *dpd = aem->con_priv;
 
-	free(dpd->regidx_fname);
-	free(dpd->regval_fname);
+	close(dpd->regidx_fd);
+	close(dpd->regval_fd);
+	free(dpd->blob_fname);
+	free(dpd->blob_buf);
 }
 
+static const struct blob_ops blob_driver = {
+	.getsize = driver_blob_getsize,
+	.read = driver_blob_read,
+};
+
 const struct connector con_driver = {
 	.name = "Driver",
 	.priv_data_sz = sizeof(struct driver_priv),
 	.caps = CON_CAP_HW,
+	.wait = CON_WAIT_SLEEP,
 	.init = driver_init,
 	.clean = driver_clean,
 	.reg_read = driver_reg_read,
 	.reg_write = driver_reg_write,
 	.reg_rmw = driver_reg_rmw,
+	.reg_read_bulk = driver_reg_read_bulk,
+	.reg_write_bulk = driver_reg_write_bulk,
+	.blob = &blob_driver,
 };
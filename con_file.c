@@ -14,10 +14,21 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
 #include "atheepmgr.h"
 
 struct file_priv {
 	FILE *fp;
+	char *path;		/* Resolved dump file path */
+	uint8_t *map;		/* File mapping, NULL if stdio access is used */
+	size_t map_sz;		/* File mapping size */
+	uint8_t *img;		/* Modified file image, NULL until first write */
+	uint32_t dirty_start;	/* Modified range start */
+	uint32_t dirty_end;	/* Modified range end, 0 if image is clean */
+	uint32_t file_len;	/* Original file length */
 	uint32_t data_len;	/* File data length */
 	uint32_t ic_sz;		/* IC size for addr wrap emulation */
 };
@@ -53,6 +64,36 @@ static void file_reg_rmw(struct atheepmgr *aem, uint32_t reg, uint32_t set,
 	fprintf(stderr, "confile: direct reg RMW is not supported\n");
 }
 
+/**
+ * (Re-)map the whole dump file to the process memory. Mapping failure is not
+ * fatal since we are always able to fallback to the stdio based access.
+ */
+static void file_map(struct atheepmgr *aem, size_t len)
+{
+	struct file_priv *fpd = aem->con_priv;
+	void *map;
+
+	if (fpd->map) {
+		munmap(fpd->map, fpd->map_sz);
+		fpd->map = NULL;
+		fpd->map_sz = 0;
+	}
+
+	if (!len)
+		return;
+
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fileno(fpd->fp), 0);
+	if (map == MAP_FAILED) {
+		if (aem->verbose)
+			printf("confile: unable to map file, fallback to stdio access: %s\n",
+			       strerror(errno));
+		return;
+	}
+
+	fpd->map = map;
+	fpd->map_sz = len;
+}
+
 static int file_blob_getsize(struct atheepmgr *aem)
 {
 	struct file_priv *fpd = aem->con_priv;
@@ -64,6 +105,13 @@ static int file_blob_read(struct atheepmgr *aem, void *buf, int len)
 {
 	struct file_priv *fpd = aem->con_priv;
 
+	if (fpd->img || fpd->map) {
+		if (len > fpd->data_len)
+			len = fpd->data_len;
+		memcpy(buf, fpd->img ? fpd->img : fpd->map, len);
+		return len;
+	}
+
 	if (fseek(fpd->fp, 0, SEEK_SET) != 0)
 		return -1;
 
@@ -82,6 +130,12 @@ static bool file_eeprom_read(struct atheepmgr *aem, uint32_t off, uint16_t *data
 		return true;
 	}
 
+	if (fpd->img || fpd->map) {
+		memcpy(data, (fpd->img ? fpd->img : fpd->map) + pos,
+		       sizeof(uint16_t));
+		return true;
+	}
+
 	if (fseek(fpd->fp, pos, SEEK_SET) != 0)
 		return false;
 
@@ -91,30 +145,101 @@ static bool file_eeprom_read(struct atheepmgr *aem, uint32_t off, uint16_t *data
 	return true;
 }
 
+static bool file_eeprom_read_range(struct atheepmgr *aem, uint32_t off,
+				   uint16_t *buf, unsigned int cnt)
+{
+	struct file_priv *fpd = aem->con_priv;
+	const uint8_t *data = fpd->img ? fpd->img : fpd->map;
+	uint32_t pos, len;
+
+	if (!data) {	/* Stdio access, go word by word */
+		for (; cnt; --cnt, ++off, ++buf)
+			if (!file_eeprom_read(aem, off, buf))
+				return false;
+		return true;
+	}
+
+	/* Copy the range by chunks, each ends at the data end or on a wrap */
+	while (cnt) {
+		pos = (off * 2) % fpd->ic_sz;
+		if (pos < fpd->data_len) {
+			len = fpd->data_len - pos;
+			if (len > cnt * 2)
+				len = cnt * 2;
+			memcpy(buf, data + pos, len);
+			if (len % 2)	/* Odd data length, pad last word */
+				((uint8_t *)buf)[len++] = 0xff;
+		} else {
+			len = fpd->ic_sz - pos;
+			if (len > cnt * 2)
+				len = cnt * 2;
+			memset(buf, 0xff, len);
+		}
+		off += len / 2;
+		buf += len / 2;
+		cnt -= len / 2;
+	}
+
+	return true;
+}
+
+/**
+ * Load the whole file contents into the memory image, that will accumulate
+ * all the modifications until the connector cleanup. The image is allocated
+ * with the emulated IC size, so it never needs to be grown.
+ */
+static bool file_img_load(struct atheepmgr *aem)
+{
+	struct file_priv *fpd = aem->con_priv;
+
+	fpd->img = malloc(fpd->ic_sz + 1);	/* +1 for odd length file tail */
+	if (!fpd->img) {
+		fprintf(stderr, "confile: can not allocate file image\n");
+		return false;
+	}
+
+	if (fpd->map) {
+		memcpy(fpd->img, fpd->map, fpd->file_len);
+		file_map(aem, 0);	/* Image supersedes the mapping */
+	} else if (fseek(fpd->fp, 0, SEEK_SET) != 0 ||
+		   fread(fpd->img, 1, fpd->file_len, fpd->fp) != fpd->file_len) {
+		fprintf(stderr, "confile: can not load file image: %s\n",
+			strerror(errno));
+		free(fpd->img);
+		fpd->img = NULL;
+		return false;
+	}
+
+	return true;
+}
+
 static bool file_eeprom_write(struct atheepmgr *aem, uint32_t off, uint16_t data)
 {
 	struct file_priv *fpd = aem->con_priv;
-	static const uint16_t fill = 0xffff;
-	uint32_t pos = off * 2, addr;
+	uint32_t pos = off * 2;
+	uint32_t start;
 
 	pos = pos % fpd->ic_sz;		/* Emulate address wrap */
 
+	if (!fpd->img && !file_img_load(aem))
+		return false;
+
+	start = pos;
 	if (pos >= fpd->data_len) {
 		/* Fill the empty area before writing position */
-		if (fseek(fpd->fp, fpd->data_len, SEEK_SET) != 0)
-			return false;
-		for (addr = fpd->data_len; addr < pos; addr += sizeof(uint16_t))
-			if (fwrite(&fill, sizeof(uint16_t), 1, fpd->fp) != 1)
-				return false;
+		memset(fpd->img + fpd->data_len, 0xff, pos - fpd->data_len);
+		start = fpd->data_len;		/* NB: with the filled area */
 		fpd->data_len = pos + sizeof(uint16_t);	/* NB: with new data */
-	} else {
-		/* Immediatly go to writing position */
-		if (fseek(fpd->fp, pos, SEEK_SET) != 0)
-			return false;
+	} else if (memcmp(fpd->img + pos, &data, sizeof(uint16_t)) == 0) {
+		return true;			/* Nothing to change */
 	}
 
-	if (fwrite(&data, sizeof(uint16_t), 1, fpd->fp) != 1)
-		return false;
+	memcpy(fpd->img + pos, &data, sizeof(uint16_t));
+
+	if (!fpd->dirty_end || start < fpd->dirty_start)
+		fpd->dirty_start = start;
+	if (pos + sizeof(uint16_t) > fpd->dirty_end)
+		fpd->dirty_end = pos + sizeof(uint16_t);
 
 	return true;
 }
@@ -128,6 +253,11 @@ static bool file_otp_read(struct atheepmgr *aem, uint32_t off, uint8_t *data)
 		return true;
 	}
 
+	if (fpd->img || fpd->map) {
+		*data = fpd->img ? fpd->img[off] : fpd->map[off];
+		return true;
+	}
+
 	if (fseek(fpd->fp, off, SEEK_SET) != 0)
 		return false;
 
@@ -137,13 +267,193 @@ static bool file_otp_read(struct atheepmgr *aem, uint32_t off, uint8_t *data)
 	return true;
 }
 
+/**
+ * Write the modified range back to the file in place. Used for device nodes
+ * (e.g. /dev/mtdblockN) and other files, which could not be replaced.
+ */
+static bool file_img_store_inplace(struct atheepmgr *aem)
+{
+	struct file_priv *fpd = aem->con_priv;
+	uint32_t len = fpd->dirty_end - fpd->dirty_start;
+	FILE *fp;
+	bool res;
+
+	fp = fopen(fpd->path, "r+b");
+	if (!fp) {
+		fprintf(stderr, "confile: can not open dump file '%s' for writing: %s\n",
+			fpd->path, strerror(errno));
+		return false;
+	}
+
+	res = fseek(fp, fpd->dirty_start, SEEK_SET) == 0 &&
+	      fwrite(fpd->img + fpd->dirty_start, 1, len, fp) == len &&
+	      fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+	if (!res)
+		fprintf(stderr, "confile: can not write dump file '%s': %s\n",
+			fpd->path, strerror(errno));
+
+	if (fclose(fp) != 0 && res) {
+		fprintf(stderr, "confile: can not close dump file '%s': %s\n",
+			fpd->path, strerror(errno));
+		res = false;
+	}
+
+	return res;
+}
+
+/**
+ * Store the whole image to a temporary file in the same directory, which
+ * then atomically replaces the original one, so a half-written dump is never
+ * left. The original file owner and permissions are preserved. If the owner
+ * could not be preserved, the file is updated in place instead.
+ */
+static bool file_img_store_atomic(struct atheepmgr *aem,
+				  const struct stat *statbuf)
+{
+	struct file_priv *fpd = aem->con_priv;
+	uint32_t done, len;
+	char *tmp;
+	ssize_t res;
+	int fd;
+
+	len = fpd->data_len > fpd->file_len ? fpd->data_len : fpd->file_len;
+
+	tmp = malloc(strlen(fpd->path) + sizeof(".XXXXXX"));
+	if (!tmp) {
+		fprintf(stderr, "confile: can not allocate temporary file name\n");
+		return false;
+	}
+	sprintf(tmp, "%s.XXXXXX", fpd->path);
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		fprintf(stderr, "confile: can not create temporary file '%s': %s\n",
+			tmp, strerror(errno));
+		free(tmp);
+		return false;
+	}
+
+	if (fchown(fd, statbuf->st_uid, statbuf->st_gid) != 0) {
+		if (errno != EPERM) {
+			fprintf(stderr, "confile: can not set temporary file '%s' owner: %s\n",
+				tmp, strerror(errno));
+			goto err;
+		}
+		/* Not allowed to keep the owner, so do not replace the file */
+		if (aem->verbose)
+			printf("confile: can not preserve '%s' owner, update it in place\n",
+			       fpd->path);
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		return file_img_store_inplace(aem);
+	}
+
+	if (fchmod(fd, statbuf->st_mode & 07777) != 0) {
+		fprintf(stderr, "confile: can not set temporary file '%s' mode: %s\n",
+			tmp, strerror(errno));
+		goto err;
+	}
+
+	for (done = 0; done < len; done += res) {
+		res = write(fd, fpd->img + done, len - done);
+		if (res < 0) {
+			if (errno == EINTR) {
+				res = 0;
+				continue;
+			}
+			fprintf(stderr, "confile: can not write temporary file '%s': %s\n",
+				tmp, strerror(errno));
+			goto err;
+		}
+	}
+
+	if (fsync(fd) != 0) {
+		fprintf(stderr, "confile: can not sync temporary file '%s': %s\n",
+			tmp, strerror(errno));
+		goto err;
+	}
+
+	if (close(fd) != 0) {
+		fd = -1;
+		fprintf(stderr, "confile: can not close temporary file '%s': %s\n",
+			tmp, strerror(errno));
+		goto err;
+	}
+	fd = -1;
+
+	if (rename(tmp, fpd->path) != 0) {
+		fprintf(stderr, "confile: can not replace dump file '%s': %s\n",
+			fpd->path, strerror(errno));
+		goto err;
+	}
+
+	free(tmp);
+
+	return true;
+
+err:
+	if (fd >= 0)
+		close(fd);
+	unlink(tmp);
+	free(tmp);
+
+	return false;
+}
+
+/**
+ * Store the modified image. Only a regular file without other hard links is
+ * replaced atomically, anything else is updated in place.
+ */
+static int file_flush(struct atheepmgr *aem)
+{
+	struct file_priv *fpd = aem->con_priv;
+	struct stat statbuf;
+	bool res;
+
+	if (!fpd->dirty_end)
+		return 0;
+
+	if (aem->verbose)
+		printf("confile: store modified range 0x%04x-0x%04x to '%s'\n",
+		       fpd->dirty_start, fpd->dirty_end - 1, fpd->path);
+
+	if (fstat(fileno(fpd->fp), &statbuf) == 0 &&
+	    S_ISREG(statbuf.st_mode) && statbuf.st_nlink == 1)
+		res = file_img_store_atomic(aem, &statbuf);
+	else
+		res = file_img_store_inplace(aem);
+	if (!res)
+		return -EIO;
+
+	fpd->dirty_end = 0;	/* Image is clean now */
+
+	return 0;
+}
+
 static int file_init(struct atheepmgr *aem, const char *arg_str)
 {
 	struct file_priv *fpd = aem->con_priv;
+	struct stat statbuf;
 	int err;
 	long len;
 
-	fpd->fp = fopen(arg_str, "r+b");
+	fpd->fp = NULL;
+	fpd->map = NULL;
+	fpd->map_sz = 0;
+	fpd->img = NULL;
+	fpd->dirty_start = 0;
+	fpd->dirty_end = 0;
+
+	/* Resolve symlinks to replace the target file on changes flushing */
+	fpd->path = realpath(arg_str, NULL);
+	if (!fpd->path) {
+		fprintf(stderr, "confile: can not resolve dump file path '%s': %s\n",
+			arg_str, strerror(errno));
+		goto err;
+	}
+
+	fpd->fp = fopen(fpd->path, "rb");
 	if (!fpd->fp) {
 		fprintf(stderr, "confile: can not open dump file '%s': %s\n",
 			arg_str, strerror(errno));
@@ -163,6 +473,7 @@ static int file_init(struct atheepmgr *aem, const char *arg_str)
 		goto err;
 	}
 
+	fpd->file_len = len;
 	fpd->data_len = len & ~1;	/* Align to 16 bit */
 	fpd->ic_sz = roundup_pow_of_2(fpd->data_len);
 	if (fpd->ic_sz < 0x0800)	/* Do not emulate too small IC */
@@ -173,12 +484,17 @@ static int file_init(struct atheepmgr *aem, const char *arg_str)
 		       len, len, fpd->ic_sz, fpd->ic_sz / 1024,
 		       fpd->ic_sz * 8 / 1024);
 
+	/* Pipes and other special files could not be mapped */
+	if (fstat(fileno(fpd->fp), &statbuf) == 0 && S_ISREG(statbuf.st_mode))
+		file_map(aem, len);
+
 	return 0;
 
 err:
 	err = errno;
 	if (fpd->fp)
 		fclose(fpd->fp);
+	free(fpd->path);
 
 	return -err;
 }
@@ -187,7 +503,10 @@ static void file_clean(struct atheepmgr *aem)
 {
 	struct file_priv *fpd = aem->con_priv;
 
+	file_map(aem, 0);	/* Unmap */
+	free(fpd->img);
 	fclose(fpd->fp);
+	free(fpd->path);
 }
 
 static const struct blob_ops blob_file = {
@@ -197,6 +516,7 @@ static const struct blob_ops blob_file = {
 
 static const struct eep_ops eep_file = {
 	.read = file_eeprom_read,
+	.read_range = file_eeprom_read_range,
 	.write = file_eeprom_write,
 };
 
@@ -209,6 +529,7 @@ const struct connector con_file = {
 	.priv_data_sz = sizeof(struct file_priv),
 	.init = file_init,
 	.clean = file_clean,
+	.flush = file_flush,
 	.reg_read = file_reg_read,
 	.reg_write = file_reg_write,
 	.reg_rmw = file_reg_rmw,
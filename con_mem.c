@@ -24,13 +24,108 @@
 struct mem_priv {
 	int devmem_fd;
 	off_t io_addr;
-	void *io_map;
+	void *io_map;		/* Registers base, NULL until first access */
+	void *map;		/* Page aligned mapping start */
+	size_t map_sz;		/* Mapping size */
+	size_t io_sz;		/* Mapped registers space size */
+	size_t io_limit;	/* I/O region size, 0 if unknown */
 };
 
+/**
+ * Lookup the I/O memory region, which contains the specified address, in
+ * the /proc/iomem to avoid mapping of adjacent devices. Returns the region
+ * size starting from the address or zero if the region size is unknown.
+ */
+static size_t mem_iomem_limit(off_t addr)
+{
+	unsigned long long start, end, best_start = 0, best_end = 0;
+	bool found = false;
+	char line[0x100];
+	FILE *fp;
+
+	fp = fopen("/proc/iomem", "r");
+	if (!fp)
+		return 0;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, " %llx-%llx :", &start, &end) != 2)
+			continue;
+		if (start > addr || end < addr || start == end)
+			continue;
+		/* Nested regions are more specific */
+		if (!found || end - start < best_end - best_start) {
+			best_start = start;
+			best_end = end;
+			found = true;
+		}
+	}
+
+	fclose(fp);
+
+	return found ? best_end - addr + 1 : 0;
+}
+
+/**
+ * Map I/O memory on demand, since the register space size is known only
+ * after the chip revision detection. Mapping is grown to cover the chip
+ * registers footprint or the accessed register.
+ */
+static bool mem_map(struct atheepmgr *aem, uint32_t reg)
+{
+	struct mem_priv *mpd = aem->con_priv;
+	long pgsz = sysconf(_SC_PAGESIZE);
+	size_t sz = hw_regs_footprint(aem), map_sz;
+	off_t map_addr = mpd->io_addr & ~((off_t)pgsz - 1);
+	void *map;
+
+	if (sz < reg + sizeof(uint32_t))
+		sz = reg + sizeof(uint32_t);
+	if (mpd->io_limit && sz > mpd->io_limit) {
+		if (reg + sizeof(uint32_t) > mpd->io_limit) {
+			fprintf(stderr, "conmem: register 0x%08x is out of the device I/O memory region (0x%08lx bytes)\n",
+				reg, (unsigned long)mpd->io_limit);
+			return false;
+		}
+		sz = mpd->io_limit;
+	}
+
+	map_sz = (mpd->io_addr - map_addr + sz + pgsz - 1) & ~(pgsz - 1);
+	map = mmap(NULL, map_sz, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_FILE, mpd->devmem_fd, map_addr);
+	if (MAP_FAILED == map) {
+		fprintf(stderr, "conmem: mmap of device at 0x%08lx for 0x%08lx bytes failed: %s\n",
+			(unsigned long)map_addr, (unsigned long)map_sz,
+			strerror(errno));
+		return false;
+	}
+
+	if (aem->verbose > 1)
+		printf("conmem: map 0x%08lx bytes at 0x%08lx\n",
+		       (unsigned long)map_sz, (unsigned long)map_addr);
+
+	if (mpd->map)
+		munmap(mpd->map, mpd->map_sz);
+	mpd->map = map;
+	mpd->map_sz = map_sz;
+	mpd->io_map = map + (mpd->io_addr - map_addr);
+	mpd->io_sz = mpd->map_sz - (mpd->io_addr - map_addr);
+
+	return true;
+}
+
+#define MEM_REG_CHECK(__mpd, __reg, __err)				\
+	do {								\
+		if ((__reg) + sizeof(uint32_t) > (__mpd)->io_sz &&	\
+		    !mem_map(aem, __reg))				\
+			return __err;					\
+	} while (0)
+
 static uint32_t mem_reg_read(struct atheepmgr *aem, uint32_t reg)
 {
 	struct mem_priv *mpd = aem->con_priv;
 
+	MEM_REG_CHECK(mpd, reg, 0xffffffff);
+
 	return *((volatile uint32_t *)(mpd->io_map + reg));
 }
 
@@ -38,6 +133,8 @@ static void mem_reg_write(struct atheepmgr *aem, uint32_t reg, uint32_t val)
 {
 	struct mem_priv *mpd = aem->con_priv;
 
+	MEM_REG_CHECK(mpd, reg, );
+
 	*((volatile uint32_t *)(mpd->io_map + reg)) = val;
 }
 
@@ -47,16 +144,51 @@ static void mem_reg_rmw(struct atheepmgr *aem, uint32_t reg, uint32_t set,
 	struct mem_priv *mpd = aem->con_priv;
 	uint32_t tmp;
 
+	MEM_REG_CHECK(mpd, reg, );
+
 	tmp = *((volatile uint32_t *)(mpd->io_map + reg));
 	tmp &= ~clr;
 	tmp |= set;
 	*((volatile uint32_t *)(mpd->io_map + reg)) = tmp;
 }
 
+static void mem_reg_read_bulk(struct atheepmgr *aem, uint32_t reg,
+			      uint32_t *buf, unsigned int cnt)
+{
+	struct mem_priv *mpd = aem->con_priv;
+	volatile uint32_t *p;
+
+	if (!cnt)
+		return;
+	if (reg + cnt * sizeof(uint32_t) > mpd->io_sz &&
+	    !mem_map(aem, reg + (cnt - 1) * sizeof(uint32_t))) {
+		memset(buf, 0xff, cnt * sizeof(uint32_t));	/* As a bus error */
+		return;
+	}
+
+	p = mpd->io_map + reg;
+	while (cnt--)
+		*buf++ = *p++;
+}
+
+static void mem_reg_write_bulk(struct atheepmgr *aem, uint32_t reg,
+			       const uint32_t *buf, unsigned int cnt)
+{
+	struct mem_priv *mpd = aem->con_priv;
+	volatile uint32_t *p;
+
+	if (!cnt)
+		return;
+	MEM_REG_CHECK(mpd, reg + (cnt - 1) * sizeof(uint32_t), );
+
+	p = mpd->io_map + reg;
+	while (cnt--)
+		*p++ = *buf++;
+}
+
 static int mem_init(struct atheepmgr *aem, const char *arg_str)
 {
 	struct mem_priv *mpd = aem->con_priv;
-	static const size_t mem_size = 0x40000;	/* TODO: use autodetection */
 	char *endp;
 
 	errno = 0;
@@ -67,6 +199,15 @@ static int mem_init(struct atheepmgr *aem, const char *arg_str)
 		return -EINVAL;
 	}
 
+	mpd->io_map = NULL;
+	mpd->map = NULL;
+	mpd->map_sz = 0;
+	mpd->io_sz = 0;
+	mpd->io_limit = mem_iomem_limit(mpd->io_addr);
+	if (aem->verbose && mpd->io_limit)
+		printf("conmem: I/O memory region size is 0x%08lx bytes\n",
+		       (unsigned long)mpd->io_limit);
+
 	mpd->devmem_fd = open("/dev/mem", O_RDWR);
 	if (mpd->devmem_fd < 0) {
 		fprintf(stderr, "conmem: opening /dev/mem failed: %s\n",
@@ -74,16 +215,6 @@ static int mem_init(struct atheepmgr *aem, const char *arg_str)
 		return -errno;
 	}
 
-	mpd->io_map = mmap(NULL, mem_size, PROT_READ | PROT_WRITE,
-			   MAP_SHARED | MAP_FILE, mpd->devmem_fd, mpd->io_addr);
-	if (MAP_FAILED == mpd->io_map) {
-		fprintf(stderr, "conmem: mmap of device at 0x%08lx for 0x%08lx bytes failed: %s\n",
-			(unsigned long)mpd->io_addr,
-			(unsigned long)mem_size, strerror(errno));
-		close(mpd->devmem_fd);
-		return -errno;
-	}
-
 	return 0;
 }
 
@@ -91,6 +222,8 @@ static void mem_clean(struct atheepmgr *aem)
 {
 	struct mem_priv *mpd = aem->con_priv;
 
+	if (mpd->map)
+		munmap(mpd->map, mpd->map_sz);
 	close(mpd->devmem_fd);
 }
 
@@ -98,10 +231,12 @@ const struct connector con_mem = {
 	.name = "Mem",
 	.priv_data_sz = sizeof(struct mem_priv),
 	.caps = CON_CAP_HW,
+	.wait = CON_WAIT_SPIN,
 	.init = mem_init,
 	.clean = mem_clean,
 	.reg_read = mem_reg_read,
 	.reg_write = mem_reg_write,
 	.reg_rmw = mem_reg_rmw,
+	.reg_read_bulk = mem_reg_read_bulk,
+	.reg_write_bulk = mem_reg_write_bulk,
 };
-
@@ -146,6 +146,26 @@ static void pci_reg_rmw(struct atheepmgr *aem, uint32_t reg, uint32_t set,
 	*((volatile uint32_t *)(ppd->io_map + reg)) = tmp;
 }
 
+static void pci_reg_read_bulk(struct atheepmgr *aem, uint32_t reg,
+			      uint32_t *buf, unsigned int cnt)
+{
+	struct pci_priv *ppd = aem->con_priv;
+	volatile uint32_t *p = ppd->io_map + reg;
+
+	while (cnt--)
+		*buf++ = *p++;
+}
+
+static void pci_reg_write_bulk(struct atheepmgr *aem, uint32_t reg,
+			       const uint32_t *buf, unsigned int cnt)
+{
+	struct pci_priv *ppd = aem->con_priv;
+	volatile uint32_t *p = ppd->io_map + reg;
+
+	while (cnt--)
+		*p++ = *buf++;
+}
+
 static int pci_parse_devarg(const char *str, struct pci_slot_match *slot)
 {
 	int num, len;
@@ -252,9 +272,12 @@ const struct connector con_pci = {
 	.name = "PCI",
 	.priv_data_sz = sizeof(struct pci_priv),
 	.caps = CON_CAP_HW | CON_CAP_PNP,
+	.wait = CON_WAIT_SPIN,
 	.init = pci_init,
 	.clean = pci_clean,
 	.reg_read = pci_reg_read,
 	.reg_write = pci_reg_write,
 	.reg_rmw = pci_reg_rmw,
+	.reg_read_bulk = pci_reg_read_bulk,
+	.reg_write_bulk = pci_reg_write_bulk,
 };
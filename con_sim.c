@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2020 Sergey Ryazanov <ryazanov.s.a@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Simulated chip: emulates the register interface of the EEPROM and OTP
+ * controllers, so the hardware access code could be exercised and profiled
+ * without a real card. EEPROM or OTP memory contents are backed by an image
+ * file, all other registers are emulated as a plain storage.
+ */
+
+#include <time.h>
+
+#include "atheepmgr.h"
+#include "hw.h"
+#include "eep_common.h"
+#include "eep_9880.h"
+
+#define SIM_REGS_NUM		256	/* Plain registers storage size */
+#define SIM_EEP_WIN_SZ		0x800	/* AR9xxx EEPROM window size, words */
+
+struct sim_reg {
+	uint32_t addr;
+	uint32_t val;
+	bool used;
+};
+
+struct sim_priv {
+	char *fname;
+	uint8_t *img;			/* Memory contents */
+	uint32_t img_len;
+	bool img_dirty;
+	bool img_is_otp;		/* Image contains OTP mem contents */
+
+	uint32_t srev;			/* SREV register value, 0 for default */
+	uint32_t mac_ver;		/* Version, decoded from SREV */
+	unsigned lat;			/* EEPROM/OTP read latency, us */
+	unsigned wlat;			/* EEPROM write latency, us */
+	unsigned reglat;		/* Register access latency, us */
+
+	uint64_t busy_till;		/* EEPROM/OTP operation completion time */
+	uint32_t eep_addr;		/* AR5211 EEPROM address */
+	uint32_t eep_data;		/* EEPROM/OTP data latch */
+	uint32_t eep_status;		/* AR5211 status after op completion */
+	bool otp_powered;		/* QCA988x OTP VDD12 */
+
+	struct sim_reg regs[SIM_REGS_NUM];
+
+	unsigned long nreads, nwrites;	/* Statistics */
+};
+
+/* Default SREV values for the chips, served by EEPROM maps */
+static const struct {
+	const char *eepmap;
+	uint32_t srev;
+} sim_srevs[] = {
+	{ "5211", AR_SREV_VERSION_5211 << AR_SREV_VERSION_S },
+	{ "5416", AR_SREV_VERSION_5416 << AR_SREV_VERSION_S },
+	{ "9285", AR_SREV_VERSION_9285 << AR_SREV_TYPE2_S | 0x01 << AR_SREV_TYPE2_S | 0x2ff },
+	{ "9287", AR_SREV_VERSION_9287 << AR_SREV_TYPE2_S | 0x1ff },
+	{ "9300", AR_SREV_VERSION_9300 << AR_SREV_TYPE2_S | 0x2ff },
+	{ "9880", AR_SREV_VERSION_9880 << AR_SREV_TYPE2_S | 0x20 << AR_SREV_TYPE2_S | 0x2ff },
+};
+
+#define SIM_VER_AR5211(__spd)	((__spd)->mac_ver < AR_SREV_VERSION_5418)
+#define SIM_VER_AR9300(__spd)	((__spd)->mac_ver >= AR_SREV_VERSION_9300)
+#define SIM_VER_AR9340(__spd)	((__spd)->mac_ver == AR_SREV_VERSION_9340)
+#define SIM_VER_QCA988X(__spd)	((__spd)->mac_ver == AR_SREV_VERSION_9880)
+
+static uint64_t sim_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sim_delay(unsigned us)
+{
+	uint64_t deadline = sim_now_us() + us;
+
+	while (sim_now_us() < deadline)
+		;
+}
+
+/**
+ * SREV register is the first one that is read by the hardware code, and at
+ * that moment the EEPROM map is already known, so select the default SREV
+ * value lazily.
+ */
+static uint32_t sim_srev(struct atheepmgr *aem)
+{
+	struct sim_priv *spd = aem->con_priv;
+	int i;
+
+	if (!spd->srev && aem->eepmap) {
+		for (i = 0; i < ARRAY_SIZE(sim_srevs); ++i)
+			if (strcmp(sim_srevs[i].eepmap, aem->eepmap->name) == 0)
+				spd->srev = sim_srevs[i].srev;
+	}
+
+	if ((spd->srev & AR_SREV_ID) == 0xff)
+		spd->mac_ver = (spd->srev & AR_SREV_VERSION2) >> AR_SREV_TYPE2_S;
+	else
+		spd->mac_ver = MS(spd->srev, AR_SREV_VERSION);
+
+	return spd->srev;
+}
+
+static struct sim_reg *sim_reg_find(struct sim_priv *spd, uint32_t addr,
+				    bool alloc)
+{
+	unsigned i, idx = (addr >> 2) % SIM_REGS_NUM;
+
+	for (i = 0; i < SIM_REGS_NUM; ++i, idx = (idx + 1) % SIM_REGS_NUM) {
+		if (spd->regs[idx].used && spd->regs[idx].addr == addr)
+			return &spd->regs[idx];
+		if (!spd->regs[idx].used) {
+			if (!alloc)
+				return NULL;
+			spd->regs[idx].used = true;
+			spd->regs[idx].addr = addr;
+			spd->regs[idx].val = 0;
+			return &spd->regs[idx];
+		}
+	}
+
+	return NULL;
+}
+
+static uint16_t sim_eep_word(struct sim_priv *spd, uint32_t off)
+{
+	uint16_t word;
+
+	if (spd->img_is_otp || off * 2 + 1 >= spd->img_len)
+		return 0xffff;
+	memcpy(&word, spd->img + off * 2, sizeof(word));
+
+	return word;
+}
+
+static void sim_eep_word_set(struct sim_priv *spd, uint32_t off, uint16_t word)
+{
+	if (spd->img_is_otp || off * 2 + 1 >= spd->img_len)
+		return;
+	memcpy(spd->img + off * 2, &word, sizeof(word));
+	spd->img_dirty = true;
+}
+
+static uint8_t sim_otp_byte(struct sim_priv *spd, uint32_t off)
+{
+	if (!spd->img_is_otp || off >= spd->img_len)
+		return 0x00;
+
+	return spd->img[off];
+}
+
+static bool sim_busy(struct sim_priv *spd)
+{
+	return spd->busy_till && sim_now_us() < spd->busy_till;
+}
+
+static uint32_t sim_reg_read(struct atheepmgr *aem, uint32_t reg)
+{
+	struct sim_priv *spd = aem->con_priv;
+	struct sim_reg *r;
+	uint32_t val, i;
+
+	spd->nreads++;
+	if (spd->reglat)
+		sim_delay(spd->reglat);
+
+	if (aem->eepmap && reg == aem->eepmap->chip_regs.srev)
+		return sim_srev(aem);
+
+	if (SIM_VER_AR5211(spd)) {
+		switch (reg) {
+		case AR5211_EEPROM_STATUS:
+			return sim_busy(spd) ? 0 : spd->eep_status;
+		case AR5211_EEPROM_DATA:
+			return spd->eep_data;
+		}
+	} else if (SIM_VER_QCA988X(spd)) {
+		if (reg == QCA988X_OTP_STATUS)
+			return spd->otp_powered && !sim_busy(spd) ?
+			       QCA988X_OTP_STATUS_VDD12_RDY : 0;
+		if (reg >= QCA988X_OTP_DATA &&
+		    reg < QCA988X_OTP_DATA + QCA9880_OTP_SIZE * 4) {
+			if (!spd->otp_powered)
+				return 0;
+			if (spd->lat)
+				sim_delay(spd->lat);
+			return sim_otp_byte(spd, (reg - QCA988X_OTP_DATA) / 4);
+		}
+	} else {
+		if (reg >= AR5416_EEPROM_OFFSET &&
+		    reg < AR5416_EEPROM_OFFSET + (SIM_EEP_WIN_SZ << AR5416_EEPROM_S)) {
+			/* Start EEPROM reading */
+			spd->eep_data = sim_eep_word(spd, (reg - AR5416_EEPROM_OFFSET) >>
+							  AR5416_EEPROM_S);
+			spd->busy_till = sim_now_us() + spd->lat;
+			return 0;
+		}
+		if (reg == (SIM_VER_AR9340(spd) ? 0x40c8 :
+			    SIM_VER_AR9300(spd) ? 0x4084 : 0x407c)) {
+			val = spd->eep_data & AR_EEPROM_STATUS_DATA_VAL;
+			if (sim_busy(spd))
+				val |= AR_EEPROM_STATUS_DATA_BUSY;
+			return val;
+		}
+		if (SIM_VER_AR9300(spd) && reg >= AR9300_OTP_BASE &&
+		    reg < AR9300_OTP_STATUS) {
+			/* Start OTP word reading */
+			i = (reg - AR9300_OTP_BASE) & ~0x3;
+			spd->eep_data = sim_otp_byte(spd, i) |
+					sim_otp_byte(spd, i + 1) << 8 |
+					sim_otp_byte(spd, i + 2) << 16 |
+					sim_otp_byte(spd, i + 3) << 24;
+			spd->busy_till = sim_now_us() + spd->lat;
+			return 0;
+		}
+		if (SIM_VER_AR9300(spd) && reg == AR9300_OTP_STATUS)
+			return sim_busy(spd) ? AR9300_OTP_STATUS_ACCESS_BUSY :
+			       AR9300_OTP_STATUS_VALID;
+		if (SIM_VER_AR9300(spd) && reg == AR9300_OTP_READ_DATA)
+			return spd->eep_data;
+	}
+
+	r = sim_reg_find(spd, reg, false);
+
+	return r ? r->val : 0;
+}
+
+static void sim_reg_write(struct atheepmgr *aem, uint32_t reg, uint32_t val)
+{
+	struct sim_priv *spd = aem->con_priv;
+	struct sim_reg *r;
+
+	spd->nwrites++;
+	if (spd->reglat)
+		sim_delay(spd->reglat);
+
+	if (SIM_VER_AR5211(spd)) {
+		switch (reg) {
+		case AR5211_EEPROM_ADDR:
+			spd->eep_addr = val & 0xffff;
+			return;
+		case AR5211_EEPROM_DATA:
+			spd->eep_data = val & 0xffff;
+			return;
+		case AR5211_EEPROM_CMD:
+			if (val & AR5211_EEPROM_CMD_READ) {
+				spd->eep_data = sim_eep_word(spd, spd->eep_addr);
+				spd->eep_status = AR5211_EEPROM_STATUS_READ_COMPLETE;
+				spd->busy_till = sim_now_us() + spd->lat;
+			} else if (val & AR5211_EEPROM_CMD_WRITE) {
+				sim_eep_word_set(spd, spd->eep_addr, spd->eep_data);
+				spd->eep_status = AR5211_EEPROM_STATUS_WRITE_COMPLETE;
+				spd->busy_till = sim_now_us() + spd->wlat;
+			}
+			return;
+		}
+	} else if (SIM_VER_QCA988X(spd)) {
+		if (reg == QCA988X_OTP_CTRL) {
+			spd->otp_powered = !!(val & QCA988X_OTP_CTRL_VDD12);
+			spd->busy_till = sim_now_us() + spd->lat;
+		}
+	} else if (reg >= AR5416_EEPROM_OFFSET &&
+		   reg < AR5416_EEPROM_OFFSET + (SIM_EEP_WIN_SZ << AR5416_EEPROM_S)) {
+		sim_eep_word_set(spd, (reg - AR5416_EEPROM_OFFSET) >>
+				      AR5416_EEPROM_S, val);
+		spd->eep_data = val;
+		spd->busy_till = sim_now_us() + spd->wlat;
+		return;
+	}
+
+	r = sim_reg_find(spd, reg, true);
+	if (r)
+		r->val = val;
+}
+
+static void sim_reg_rmw(struct atheepmgr *aem, uint32_t reg, uint32_t set,
+			uint32_t clr)
+{
+	uint32_t val = sim_reg_read(aem, reg);
+
+	val &= ~clr;
+	val |= set;
+
+	sim_reg_write(aem, reg, val);
+}
+
+static int sim_parse_uint(const char *str, const char *name, unsigned *res)
+{
+	unsigned long val;
+	char *endp;
+
+	val = strtoul(str, &endp, 0);
+	if (*str == '\0' || *endp != '\0' || val > UINT32_MAX) {
+		fprintf(stderr, "consim: invalid %s value -- %s\n", name, str);
+		return -1;
+	}
+	*res = val;
+
+	return 0;
+}
+
+static int sim_init(struct atheepmgr *aem, const char *arg_str)
+{
+	struct sim_priv *spd = aem->con_priv;
+	char *args, *arg, *val, *saveptr;
+	int err = EINVAL;
+	unsigned srev;
+	FILE *fp;
+	long len;
+
+	memset(spd, 0x00, sizeof(*spd));
+
+	args = strdup(arg_str);
+	if (!args) {
+		fprintf(stderr, "consim: unable to allocate memory for arguments\n");
+		return -ENOMEM;
+	}
+
+	arg = strtok_r(args, ",", &saveptr);
+	if (!arg) {
+		fprintf(stderr, "consim: image file is not specified\n");
+		goto err;
+	}
+	spd->fname = strdup(arg);
+	if (!spd->fname) {
+		fprintf(stderr, "consim: unable to allocate memory for image file name\n");
+		err = ENOMEM;
+		goto err;
+	}
+
+	while ((arg = strtok_r(NULL, ",", &saveptr)) != NULL) {
+		val = strchr(arg, '=');
+		if (val)
+			*val++ = '\0';
+		if (strcmp(arg, "otp") == 0 && !val) {
+			spd->img_is_otp = true;
+		} else if (strcmp(arg, "srev") == 0 && val) {
+			if (sim_parse_uint(val, arg, &srev))
+				goto err;
+			spd->srev = srev;
+		} else if (strcmp(arg, "lat") == 0 && val) {
+			if (sim_parse_uint(val, arg, &spd->lat))
+				goto err;
+		} else if (strcmp(arg, "wlat") == 0 && val) {
+			if (sim_parse_uint(val, arg, &spd->wlat))
+				goto err;
+		} else if (strcmp(arg, "reglat") == 0 && val) {
+			if (sim_parse_uint(val, arg, &spd->reglat))
+				goto err;
+		} else {
+			fprintf(stderr, "consim: unknown option -- %s\n", arg);
+			goto err;
+		}
+	}
+
+	fp = fopen(spd->fname, "rb");
+	if (!fp) {
+		err = errno;
+		fprintf(stderr, "consim: can not open image file '%s': %s\n",
+			spd->fname, strerror(errno));
+		goto err;
+	}
+	if (fseek(fp, 0, SEEK_END) != 0 || (len = ftell(fp)) < 0 ||
+	    fseek(fp, 0, SEEK_SET) != 0) {
+		err = errno;
+		fprintf(stderr, "consim: can not detect image size: %s\n",
+			strerror(errno));
+		fclose(fp);
+		goto err;
+	}
+	spd->img_len = len;
+	spd->img = malloc(len + 1);
+	if (!spd->img) {
+		fprintf(stderr, "consim: unable to allocate memory for image\n");
+		fclose(fp);
+		err = ENOMEM;
+		goto err;
+	}
+	if (fread(spd->img, 1, len, fp) != len) {
+		fprintf(stderr, "consim: can not read image file '%s'\n",
+			spd->fname);
+		fclose(fp);
+		err = EIO;
+		goto err;
+	}
+	fclose(fp);
+
+	if (aem->verbose)
+		printf("consim: emulate %u bytes of %s, read latency %u us, write latency %u us\n",
+		       spd->img_len, spd->img_is_otp ? "OTP mem" : "EEPROM",
+		       spd->lat, spd->wlat);
+
+	free(args);
+
+	return 0;
+
+err:
+	free(spd->img);
+	free(spd->fname);
+	free(args);
+
+	return -err;
+}
+
+static void sim_clean(struct atheepmgr *aem)
+{
+	struct sim_priv *spd = aem->con_priv;
+	FILE *fp;
+
+	if (aem->verbose)
+		printf("consim: %lu register reads, %lu register writes\n",
+		       spd->nreads, spd->nwrites);
+
+	if (spd->img_dirty) {
+		fp = fopen(spd->fname, "r+b");
+		if (!fp || fwrite(spd->img, 1, spd->img_len, fp) != spd->img_len)
+			fprintf(stderr, "consim: unable to store image to '%s': %s\n",
+				spd->fname, strerror(errno));
+		if (fp)
+			fclose(fp);
+	}
+
+	free(spd->img);
+	free(spd->fname);
+}
+
+const struct connector con_sim = {
+	.name = "Sim",
+	.priv_data_sz = sizeof(struct sim_priv),
+	.caps = CON_CAP_HW,
+	.init = sim_init,
+	.clean = sim_clean,
+	.reg_read = sim_reg_read,
+	.reg_write = sim_reg_write,
+	.reg_rmw = sim_reg_rmw,
+};
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2020 Sergey Ryazanov <ryazanov.s.a@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Access a PCI device via the sysfs: the device Ids are read from the device
+ * directory and the BAR0 is mapped via the resource0 file. Unlike libpciaccess
+ * only the specified device is touched, without the whole bus scanning.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#include "atheepmgr.h"
+
+#define SYSFS_ROOT_ENV		"ATHEEPMGR_SYSFS_ROOT"
+#define SYSFS_ROOT		"/sys"
+#define SYSFS_PCI_DEVICES_PATH	"/bus/pci/devices"
+
+#define ATHEROS_VENDOR_ID	0x168c
+
+struct sysfs_priv {
+	int res_fd;
+	size_t size;
+	void *io_map;
+};
+
+static uint32_t sysfs_reg_read(struct atheepmgr *aem, uint32_t reg)
+{
+	struct sysfs_priv *spd = aem->con_priv;
+
+	return *((volatile uint32_t *)(spd->io_map + reg));
+}
+
+static void sysfs_reg_write(struct atheepmgr *aem, uint32_t reg, uint32_t val)
+{
+	struct sysfs_priv *spd = aem->con_priv;
+
+	*((volatile uint32_t *)(spd->io_map + reg)) = val;
+}
+
+static void sysfs_reg_rmw(struct atheepmgr *aem, uint32_t reg, uint32_t set,
+			  uint32_t clr)
+{
+	struct sysfs_priv *spd = aem->con_priv;
+	uint32_t tmp;
+
+	tmp = *((volatile uint32_t *)(spd->io_map + reg));
+	tmp &= ~clr;
+	tmp |= set;
+	*((volatile uint32_t *)(spd->io_map + reg)) = tmp;
+}
+
+static void sysfs_reg_read_bulk(struct atheepmgr *aem, uint32_t reg,
+				uint32_t *buf, unsigned int cnt)
+{
+	struct sysfs_priv *spd = aem->con_priv;
+	volatile uint32_t *p = spd->io_map + reg;
+
+	while (cnt--)
+		*buf++ = *p++;
+}
+
+static void sysfs_reg_write_bulk(struct atheepmgr *aem, uint32_t reg,
+				 const uint32_t *buf, unsigned int cnt)
+{
+	struct sysfs_priv *spd = aem->con_priv;
+	volatile uint32_t *p = spd->io_map + reg;
+
+	while (cnt--)
+		*p++ = *buf++;
+}
+
+static int sysfs_read_id(const char *devpath, const char *attr,
+			 unsigned int *pid)
+{
+	char path[0x100];
+	FILE *fp;
+	int res;
+
+	snprintf(path, sizeof(path), "%s/%s", devpath, attr);
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "consysfs: unable to open %s: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+	res = fscanf(fp, "%x", pid);
+	fclose(fp);
+	if (res != 1) {
+		fprintf(stderr, "consysfs: unable to parse %s contents\n",
+			path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int sysfs_find_device(const char *root, const char *str, char *devpath,
+			     size_t len)
+{
+	unsigned int domain = 0, bus, dev, func;
+	int num, n, i;
+	struct stat statbuf;
+
+	num = sscanf(str, "%x:%x:%x.%u%n", &domain, &bus, &dev, &func, &n);
+	if (num == 4 && str[n] == '\0')
+		goto found_func;
+	num = sscanf(str, "%x:%x:%x%n", &domain, &bus, &dev, &n);
+	if (num == 3 && str[n] == '\0')
+		goto find_func;
+	domain = 0;
+	num = sscanf(str, "%x:%x.%u%n", &bus, &dev, &func, &n);
+	if (num == 3 && str[n] == '\0')
+		goto found_func;
+	num = sscanf(str, "%x:%x%n", &bus, &dev, &n);
+	if (num == 2 && str[n] == '\0')
+		goto find_func;
+
+	fprintf(stderr, "Invalid PCI slot specification -- %s\n", str);
+
+	return -EINVAL;
+
+find_func:
+	/* Use first available function as libpciaccess does */
+	for (i = 0; i < 8; ++i) {
+		snprintf(devpath, len, "%s" SYSFS_PCI_DEVICES_PATH "/%04x:%02x:%02x.%u",
+			 root, domain, bus, dev, i);
+		if (stat(devpath, &statbuf) == 0)
+			return 0;
+	}
+	fprintf(stderr, "No PCI device in specified slot %s\n", str);
+
+	return -ENODEV;
+
+found_func:
+	snprintf(devpath, len, "%s" SYSFS_PCI_DEVICES_PATH "/%04x:%02x:%02x.%u",
+		 root, domain, bus, dev, func);
+	if (stat(devpath, &statbuf) != 0) {
+		fprintf(stderr, "No PCI device in specified slot %s\n", str);
+		return -ENODEV;
+	}
+
+	return 0;
+}
+
+static int sysfs_init(struct atheepmgr *aem, const char *arg_str)
+{
+	const struct chip *chips[10];	/* 10 is an arbitrary expected maximum
+					   number of chips with a same PCI ID */
+	struct sysfs_priv *spd = aem->con_priv;
+	unsigned int vendor_id, device_id;
+	char devpath[0x100], path[0x120];
+	struct stat statbuf;
+	const char *root;
+	int ret, n, i;
+
+	root = getenv(SYSFS_ROOT_ENV);
+	if (!root)
+		root = SYSFS_ROOT;
+
+	ret = sysfs_find_device(root, arg_str, devpath, sizeof(devpath));
+	if (ret)
+		return ret;
+
+	if (sysfs_read_id(devpath, "vendor", &vendor_id) ||
+	    sysfs_read_id(devpath, "device", &device_id))
+		return -EIO;
+
+	if (vendor_id != ATHEROS_VENDOR_ID)
+		goto not_supported;
+
+	n = chips_find_by_pci_id(device_id, chips, ARRAY_SIZE(chips));
+	if (!n)
+		goto not_supported;
+
+	if (aem->verbose) {
+		printf("Found Device: %04x:%04x", vendor_id, device_id);
+		printf(" (%s", chips[0]->name);
+		for (i = 1; i < n; ++i)
+			printf("/%s", chips[i]->name);
+		printf(")\n");
+	}
+
+	aem->eepmap = chips[0]->eepmap;
+
+	snprintf(path, sizeof(path), "%s/resource0", devpath);
+	spd->res_fd = open(path, O_RDWR | O_SYNC);
+	if (spd->res_fd < 0) {
+		ret = errno;
+		fprintf(stderr, "consysfs: unable to open %s: %s\n", path,
+			strerror(errno));
+		return -ret;
+	}
+
+	if (fstat(spd->res_fd, &statbuf) != 0 || statbuf.st_size <= 0) {
+		fprintf(stderr, "consysfs: unable to detect %s size\n", path);
+		close(spd->res_fd);
+		return -EINVAL;
+	}
+	spd->size = statbuf.st_size;
+
+	if (aem->verbose)
+		printf("Try to map %s (0x%lx bytes) to the process memory\n",
+		       path, (unsigned long)spd->size);
+
+	spd->io_map = mmap(NULL, spd->size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED, spd->res_fd, 0);
+	if (spd->io_map == MAP_FAILED) {
+		ret = errno;
+		fprintf(stderr, "consysfs: mmap of %s failed: %s\n", path,
+			strerror(errno));
+		close(spd->res_fd);
+		return -ret;
+	}
+
+	if (aem->verbose)
+		printf("Mapped IO region at: %p\n", spd->io_map);
+
+	return 0;
+
+not_supported:
+	fprintf(stderr, "Device: %04x:%04x not supported\n", vendor_id,
+		device_id);
+
+	return -ENOTSUP;
+}
+
+static void sysfs_clean(struct atheepmgr *aem)
+{
+	struct sysfs_priv *spd = aem->con_priv;
+
+	munmap(spd->io_map, spd->size);
+	close(spd->res_fd);
+}
+
+const struct connector con_sysfs = {
+	.name = "Sysfs",
+	.priv_data_sz = sizeof(struct sysfs_priv),
+	.caps = CON_CAP_HW | CON_CAP_PNP,
+	.wait = CON_WAIT_SPIN,
+	.init = sysfs_init,
+	.clean = sysfs_clean,
+	.reg_read = sysfs_reg_read,
+	.reg_write = sysfs_reg_write,
+	.reg_rmw = sysfs_reg_rmw,
+	.reg_read_bulk = sysfs_reg_read_bulk,
+	.reg_write_bulk = sysfs_reg_write_bulk,
+};
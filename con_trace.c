@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) 2020 Sergey Ryazanov <ryazanov.s.a@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Register access tracing: the recording connector wraps any other connector
+ * and logs each register access to a trace file, while the replay connector
+ * serves the register reads back from the trace file without any hardware.
+ *
+ * Only the register traffic is logged. Connector own EEPROM, OTP and blob ops
+ * are passed through unrecorded, so e.g. a driver connector session, which
+ * reads the EEPROM via the driver instead of the registers, gives a trace with
+ * nothing to replay.
+ *
+ * Trace file consists of a header followed by a stream of fixed size records
+ * (all fields are little-endian). Records are only appended, so the trace
+ * could be streamed, and the file could be mapped and walked as an array.
+ */
+
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "atheepmgr.h"
+
+#define TRACE_MAGIC		"AEMTRACE"
+#define TRACE_VERSION		1
+
+struct trace_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t hdr_len;		/* Records start offset */
+	char eepmap[16];		/* Autodetected EEPROM map name, if any */
+} __attribute__((packed));
+
+#define TRACE_OP_READ		1
+#define TRACE_OP_WRITE		2
+#define TRACE_OP_RMW		3
+
+#define TRACE_OP_S		28
+#define TRACE_DT_M		0x0fffffff	/* Delay since previous op, us */
+
+struct trace_rec {
+	uint32_t op_dt;			/* Operation and delay */
+	uint32_t reg;
+	uint32_t val;			/* Read or written value or RMW set mask */
+	uint32_t aux;			/* RMW clear mask */
+} __attribute__((packed));
+
+static uint64_t trace_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Recording connector */
+
+struct trace_rec_priv {
+	FILE *fp;
+	uint64_t ts;			/* Previous operation timestamp */
+	unsigned long nrecs;
+	bool failed;
+	/* Wrapped connector private data follows */
+};
+
+static const struct connector *trace_rec_con;
+static const char *trace_rec_fname;
+
+static struct connector con_trace_rec;
+
+#define TRACE_REC_INNER_PRIV(__trp)	((void *)((__trp) + 1))
+
+/**
+ * Wrapped connector methods are called with the connector and its private
+ * data temporarily substituted, so the wrapped connector sees the context
+ * exactly as if it were used directly.
+ */
+#define TRACE_REC_ENTER(__aem)						\
+	struct trace_rec_priv *trp = (__aem)->con_priv;			\
+	(__aem)->con = trace_rec_con;					\
+	(__aem)->con_priv = TRACE_REC_INNER_PRIV(trp)
+
+#define TRACE_REC_LEAVE(__aem)						\
+	do {								\
+		(__aem)->con = &con_trace_rec;				\
+		(__aem)->con_priv = trp;				\
+	} while (0)
+
+static void trace_rec_log(struct trace_rec_priv *trp, unsigned op,
+			  uint32_t reg, uint32_t val, uint32_t aux)
+{
+	uint64_t ts = trace_now_us(), dt = ts - trp->ts;
+	struct trace_rec rec;
+
+	if (trp->failed)
+		return;
+
+	if (dt > TRACE_DT_M)
+		dt = TRACE_DT_M;
+	trp->ts = ts;
+
+	rec.op_dt = htole32(op << TRACE_OP_S | dt);
+	rec.reg = htole32(reg);
+	rec.val = htole32(val);
+	rec.aux = htole32(aux);
+
+	if (fwrite(&rec, sizeof(rec), 1, trp->fp) != 1) {
+		fprintf(stderr, "contrace: unable to write trace record: %s\n",
+			strerror(errno));
+		trp->failed = true;
+		return;
+	}
+
+	trp->nrecs++;
+}
+
+static uint32_t trace_rec_reg_read(struct atheepmgr *aem, uint32_t reg)
+{
+	TRACE_REC_ENTER(aem);
+	uint32_t val = trace_rec_con->reg_read(aem, reg);
+	TRACE_REC_LEAVE(aem);
+
+	trace_rec_log(trp, TRACE_OP_READ, reg, val, 0);
+
+	return val;
+}
+
+static void trace_rec_reg_write(struct atheepmgr *aem, uint32_t reg,
+				uint32_t val)
+{
+	TRACE_REC_ENTER(aem);
+	trace_rec_con->reg_write(aem, reg, val);
+	TRACE_REC_LEAVE(aem);
+
+	trace_rec_log(trp, TRACE_OP_WRITE, reg, val, 0);
+}
+
+static void trace_rec_reg_rmw(struct atheepmgr *aem, uint32_t reg,
+			      uint32_t set, uint32_t clr)
+{
+	TRACE_REC_ENTER(aem);
+	trace_rec_con->reg_rmw(aem, reg, set, clr);
+	TRACE_REC_LEAVE(aem);
+
+	trace_rec_log(trp, TRACE_OP_RMW, reg, set, clr);
+}
+
+/**
+ * Bulk accesses are recorded as a sequence of single register accesses, so
+ * a recorded run uses the same access pattern as an unrecorded one, while
+ * the replay could serve them via the per-register fallback.
+ */
+static void trace_rec_reg_read_bulk(struct atheepmgr *aem, uint32_t reg,
+				    uint32_t *buf, unsigned int cnt)
+{
+	unsigned int i;
+
+	TRACE_REC_ENTER(aem);
+	trace_rec_con->reg_read_bulk(aem, reg, buf, cnt);
+	TRACE_REC_LEAVE(aem);
+
+	for (i = 0; i < cnt; ++i)
+		trace_rec_log(trp, TRACE_OP_READ, reg + i * 4, buf[i], 0);
+}
+
+static void trace_rec_reg_write_bulk(struct atheepmgr *aem, uint32_t reg,
+				     const uint32_t *buf, unsigned int cnt)
+{
+	unsigned int i;
+
+	TRACE_REC_ENTER(aem);
+	trace_rec_con->reg_write_bulk(aem, reg, buf, cnt);
+	TRACE_REC_LEAVE(aem);
+
+	for (i = 0; i < cnt; ++i)
+		trace_rec_log(trp, TRACE_OP_WRITE, reg + i * 4, buf[i], 0);
+}
+
+static int trace_rec_blob_getsize(struct atheepmgr *aem)
+{
+	TRACE_REC_ENTER(aem);
+	int res = trace_rec_con->blob->getsize(aem);
+	TRACE_REC_LEAVE(aem);
+
+	return res;
+}
+
+static int trace_rec_blob_read(struct atheepmgr *aem, void *buf, int len)
+{
+	TRACE_REC_ENTER(aem);
+	int res = trace_rec_con->blob->read(aem, buf, len);
+	TRACE_REC_LEAVE(aem);
+
+	return res;
+}
+
+static bool trace_rec_eep_read(struct atheepmgr *aem, uint32_t off,
+			       uint16_t *data)
+{
+	TRACE_REC_ENTER(aem);
+	bool res = trace_rec_con->eep->read(aem, off, data);
+	TRACE_REC_LEAVE(aem);
+
+	return res;
+}
+
+static bool trace_rec_eep_read_range(struct atheepmgr *aem, uint32_t off,
+				     uint16_t *buf, unsigned int cnt)
+{
+	TRACE_REC_ENTER(aem);
+	bool res = trace_rec_con->eep->read_range(aem, off, buf, cnt);
+	TRACE_REC_LEAVE(aem);
+
+	return res;
+}
+
+static bool trace_rec_eep_write(struct atheepmgr *aem, uint32_t off,
+				uint16_t data)
+{
+	TRACE_REC_ENTER(aem);
+	bool res = trace_rec_con->eep->write(aem, off, data);
+	TRACE_REC_LEAVE(aem);
+
+	return res;
+}
+
+static bool trace_rec_otp_read(struct atheepmgr *aem, uint32_t off,
+			       uint8_t *data)
+{
+	TRACE_REC_ENTER(aem);
+	bool res = trace_rec_con->otp->read(aem, off, data);
+	TRACE_REC_LEAVE(aem);
+
+	return res;
+}
+
+static bool trace_rec_otp_read_bulk(struct atheepmgr *aem, uint32_t off,
+				    uint8_t *buf, unsigned int len)
+{
+	TRACE_REC_ENTER(aem);
+	bool res = trace_rec_con->otp->read_bulk(aem, off, buf, len);
+	TRACE_REC_LEAVE(aem);
+
+	return res;
+}
+
+static const struct blob_ops blob_trace_rec = {
+	.getsize = trace_rec_blob_getsize,
+	.read = trace_rec_blob_read,
+};
+
+/* Optional ops are filled on wrapping if the wrapped connector has them */
+static struct eep_ops eep_trace_rec = {
+	.read = trace_rec_eep_read,
+	.write = trace_rec_eep_write,
+};
+
+static struct otp_ops otp_trace_rec = {
+	.read = trace_rec_otp_read,
+};
+
+static int trace_rec_init(struct atheepmgr *aem, const char *arg_str)
+{
+	struct trace_rec_priv *trp = aem->con_priv;
+	struct trace_hdr hdr;
+	int ret;
+
+	trp->fp = fopen(trace_rec_fname, "wb");
+	if (!trp->fp) {
+		fprintf(stderr, "contrace: can not open trace file '%s': %s\n",
+			trace_rec_fname, strerror(errno));
+		return -errno;
+	}
+	trp->nrecs = 0;
+	trp->failed = false;
+
+	aem->con = trace_rec_con;
+	aem->con_priv = TRACE_REC_INNER_PRIV(trp);
+	ret = trace_rec_con->init(aem, arg_str);
+	aem->con = &con_trace_rec;
+	aem->con_priv = trp;
+	if (ret) {
+		fclose(trp->fp);
+		unlink(trace_rec_fname);
+		return ret;
+	}
+
+	memset(&hdr, 0x00, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = htole32(TRACE_VERSION);
+	hdr.hdr_len = htole32(sizeof(hdr));
+	if (aem->eepmap)
+		strncpy(hdr.eepmap, aem->eepmap->name, sizeof(hdr.eepmap) - 1);
+
+	if (fwrite(&hdr, sizeof(hdr), 1, trp->fp) != 1) {
+		fprintf(stderr, "contrace: unable to write trace header: %s\n",
+			strerror(errno));
+		trp->failed = true;
+	}
+
+	trp->ts = trace_now_us();
+
+	return 0;
+}
+
+static int trace_rec_flush(struct atheepmgr *aem)
+{
+	TRACE_REC_ENTER(aem);
+	int res = trace_rec_con->flush(aem);
+	TRACE_REC_LEAVE(aem);
+
+	return res;
+}
+
+static void trace_rec_clean(struct atheepmgr *aem)
+{
+	TRACE_REC_ENTER(aem);
+	trace_rec_con->clean(aem);
+	TRACE_REC_LEAVE(aem);
+
+	if (fclose(trp->fp) != 0 && !trp->failed) {
+		fprintf(stderr, "contrace: unable to write trace file: %s\n",
+			strerror(errno));
+		trp->failed = true;
+	}
+
+	if (aem->verbose)
+		printf("contrace: %lu register accesses recorded to '%s'%s\n",
+		       trp->nrecs, trace_rec_fname,
+		       trp->failed ? " (incomplete)" : "");
+}
+
+static struct connector con_trace_rec = {
+	.name = "Trace recorder",
+	.init = trace_rec_init,
+	.clean = trace_rec_clean,
+	.reg_read = trace_rec_reg_read,
+	.reg_write = trace_rec_reg_write,
+	.reg_rmw = trace_rec_reg_rmw,
+};
+
+/**
+ * Configure the recording connector to wrap the specified connector and
+ * return the connector, that should be used instead of the wrapped one.
+ */
+const struct connector *con_trace_rec_wrap(const struct connector *con,
+					   const char *fname)
+{
+	trace_rec_con = con;
+	trace_rec_fname = fname;
+
+	con_trace_rec.priv_data_sz = sizeof(struct trace_rec_priv) +
+				     con->priv_data_sz;
+	con_trace_rec.caps = con->caps;
+	con_trace_rec.wait = con->wait;
+	con_trace_rec.flush = con->flush ? trace_rec_flush : NULL;
+	con_trace_rec.reg_read_bulk = con->reg_read_bulk ?
+				      trace_rec_reg_read_bulk : NULL;
+	con_trace_rec.reg_write_bulk = con->reg_write_bulk ?
+				       trace_rec_reg_write_bulk : NULL;
+	con_trace_rec.blob = con->blob ? &blob_trace_rec : NULL;
+	con_trace_rec.eep = con->eep ? &eep_trace_rec : NULL;
+	con_trace_rec.otp = con->otp ? &otp_trace_rec : NULL;
+	if (con->eep && con->eep->read_range)
+		eep_trace_rec.read_range = trace_rec_eep_read_range;
+	if (con->otp && con->otp->read_bulk)
+		otp_trace_rec.read_bulk = trace_rec_otp_read_bulk;
+
+	return &con_trace_rec;
+}
+
+/* Replay connector */
+
+struct trace_play_priv {
+	void *map;
+	size_t map_sz;
+	const struct trace_rec *recs;
+	unsigned long nrecs;
+	unsigned long pos;		/* Next record to replay */
+	bool diverged;
+	long lat;			/* Per op latency, us, -1 for recorded */
+};
+
+static void trace_play_delay(unsigned long us)
+{
+	uint64_t deadline = trace_now_us() + us;
+
+	/* Spin since sleep granularity is too coarse for small latencies */
+	while (trace_now_us() < deadline)
+		;
+}
+
+/**
+ * Fetch the next trace record and check that it matches the requested
+ * operation. Register accesses sequence is deterministic for a given
+ * hardware state, so any mismatch means that the code under test behaves
+ * differently than the recorded one.
+ */
+static const struct trace_rec *trace_play_next(struct atheepmgr *aem,
+					       unsigned op, uint32_t reg)
+{
+	struct trace_play_priv *tpp = aem->con_priv;
+	const struct trace_rec *rec;
+	uint32_t op_dt;
+
+	if (tpp->diverged)
+		return NULL;
+
+	if (tpp->pos >= tpp->nrecs) {
+		fprintf(stderr, "contrace: trace is over, unexpected register 0x%08x access\n",
+			reg);
+		tpp->diverged = true;
+		return NULL;
+	}
+
+	rec = &tpp->recs[tpp->pos];
+	op_dt = le32toh(rec->op_dt);
+	if (op_dt >> TRACE_OP_S != op || le32toh(rec->reg) != reg) {
+		fprintf(stderr, "contrace: trace diverged at record #%lu: expect op %u reg 0x%08x, got op %u reg 0x%08x\n",
+			tpp->pos, op_dt >> TRACE_OP_S, le32toh(rec->reg), op,
+			reg);
+		tpp->diverged = true;
+		return NULL;
+	}
+
+	tpp->pos++;
+
+	if (tpp->lat > 0)
+		trace_play_delay(tpp->lat);
+	else if (tpp->lat < 0)
+		trace_play_delay(op_dt & TRACE_DT_M);
+
+	return rec;
+}
+
+static uint32_t trace_play_reg_read(struct atheepmgr *aem, uint32_t reg)
+{
+	const struct trace_rec *rec = trace_play_next(aem, TRACE_OP_READ, reg);
+
+	return rec ? le32toh(rec->val) : 0xffffffff;
+}
+
+static void trace_play_reg_write(struct atheepmgr *aem, uint32_t reg,
+				 uint32_t val)
+{
+	trace_play_next(aem, TRACE_OP_WRITE, reg);
+}
+
+static void trace_play_reg_rmw(struct atheepmgr *aem, uint32_t reg,
+			       uint32_t set, uint32_t clr)
+{
+	trace_play_next(aem, TRACE_OP_RMW, reg);
+}
+
+static int trace_play_init(struct atheepmgr *aem, const char *arg_str)
+{
+	struct trace_play_priv *tpp = aem->con_priv;
+	const struct trace_hdr *hdr;
+	char *fname, *p, *endp;
+	struct stat statbuf;
+	uint32_t hdr_len;
+	int fd, err;
+
+	tpp->map = NULL;
+	tpp->pos = 0;
+	tpp->diverged = false;
+	tpp->lat = 0;
+
+	fname = strdup(arg_str);
+	if (!fname) {
+		fprintf(stderr, "contrace: unable to allocate memory for trace file name\n");
+		return -ENOMEM;
+	}
+
+	p = strchr(fname, ',');
+	if (p) {
+		*p++ = '\0';
+		if (strcmp(p, "rec") == 0) {
+			tpp->lat = -1;
+		} else {
+			tpp->lat = strtol(p, &endp, 0);
+			if (*endp != '\0' || tpp->lat < 0) {
+				fprintf(stderr, "contrace: invalid latency value -- %s\n",
+					p);
+				err = EINVAL;
+				goto err;
+			}
+		}
+	}
+
+	fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		err = errno;
+		fprintf(stderr, "contrace: can not open trace file '%s': %s\n",
+			fname, strerror(errno));
+		goto err;
+	}
+
+	if (fstat(fd, &statbuf) != 0) {
+		err = errno;
+		fprintf(stderr, "contrace: can not stat trace file '%s': %s\n",
+			fname, strerror(errno));
+		close(fd);
+		goto err;
+	}
+	if (statbuf.st_size < sizeof(*hdr)) {
+		fprintf(stderr, "contrace: '%s' is too short to be a trace\n",
+			fname);
+		close(fd);
+		err = EINVAL;
+		goto err;
+	}
+
+	tpp->map_sz = statbuf.st_size;
+	tpp->map = mmap(NULL, tpp->map_sz, PROT_READ, MAP_PRIVATE, fd, 0);
+	err = errno;
+	close(fd);
+	if (tpp->map == MAP_FAILED) {
+		tpp->map = NULL;
+		fprintf(stderr, "contrace: can not map trace file '%s': %s\n",
+			fname, strerror(err));
+		goto err;
+	}
+
+	hdr = tpp->map;
+	hdr_len = le32toh(hdr->hdr_len);
+	if (memcmp(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    le32toh(hdr->version) != TRACE_VERSION ||
+	    hdr_len < sizeof(*hdr) || hdr_len > tpp->map_sz) {
+		fprintf(stderr, "contrace: '%s' is not a supported trace file\n",
+			fname);
+		err = EINVAL;
+		goto err;
+	}
+
+	tpp->recs = (const struct trace_rec *)((uint8_t *)tpp->map + hdr_len);
+	tpp->nrecs = (tpp->map_sz - hdr_len) / sizeof(struct trace_rec);
+
+	if (hdr->eepmap[0] != '\0' && hdr->eepmap[sizeof(hdr->eepmap) - 1] == '\0')
+		aem->eepmap = eepmap_find_by_name(hdr->eepmap);
+
+	if (aem->verbose)
+		printf("contrace: replay %lu register accesses from '%s'\n",
+		       tpp->nrecs, fname);
+
+	free(fname);
+
+	return 0;
+
+err:
+	if (tpp->map)
+		munmap(tpp->map, tpp->map_sz);
+	free(fname);
+
+	return -err;
+}
+
+static void trace_play_clean(struct atheepmgr *aem)
+{
+	struct trace_play_priv *tpp = aem->con_priv;
+
+	if (aem->verbose)
+		printf("contrace: %lu of %lu register accesses replayed%s\n",
+		       tpp->pos, tpp->nrecs, tpp->diverged ? ", diverged" : "");
+
+	munmap(tpp->map, tpp->map_sz);
+}
+
+const struct connector con_trace_play = {
+	.name = "Trace replay",
+	.priv_data_sz = sizeof(struct trace_play_priv),
+	.caps = CON_CAP_HW | CON_CAP_PNP,
+	.init = trace_play_init,
+	.clean = trace_play_clean,
+	.reg_read = trace_play_reg_read,
+	.reg_write = trace_play_reg_write,
+	.reg_rmw = trace_play_reg_rmw,
+	.wait = CON_WAIT_SPIN,		/* Latency is injected on each access */
+};
@@ -930,7 +930,7 @@ static bool eep_5211_load_eeprom(struct atheepmgr *aem, bool raw)
 	struct ar5211_base_eep_hdr *base = &eep->base;
 	uint16_t endloc_up, endloc_lo;
 	uint16_t magic;
-	int len = 0, addr;
+	int len = 0;
 	uint16_t *buf = aem->eep_buf;
 
 	if (raw) {	/* Use max size for RAW loading */
@@ -973,14 +973,12 @@ static bool eep_5211_load_eeprom(struct atheepmgr *aem, bool raw)
 
 data_read:
 	/* Read to intermediated buffer */
-	for (addr = 0; addr < len; ++addr, ++buf) {
-		if (!EEP_READ(addr, buf)) {
-			fprintf(stderr, "Unable to read EEPROM to buffer\n");
-			return false;
-		}
+	if (!EEP_READ_RANGE(0, buf, len)) {
+		fprintf(stderr, "Unable to read EEPROM to buffer\n");
+		return false;
 	}
 
-	aem->eep_len = addr;
+	aem->eep_len = len;
 
 	if (raw)	/* Earlier exit on RAW contents loading */
 		return true;
@@ -1499,13 +1497,15 @@ static bool eep_5211_update_eeprom(struct atheepmgr *aem, int param,
 	struct ar5211_base_eep_hdr *base = &eep->base;
 #endif
 	uint16_t *buf = aem->eep_buf;
-	int data_pos, data_len = 0, addr, el, i;
+	int data_pos, el, i;
 	uint16_t sum;
+#ifdef CONFIG_I_KNOW_WHAT_I_AM_DOING
+	int data_len, addr;
+#endif
 
 	switch (param) {
 	case EEP_UPDATE_MAC:
 		data_pos = AR5211_EEP_MAC;
-		data_len = 6 / sizeof(uint16_t);
 		for (i = 0; i < 6; ++i) {
 			((uint8_t *)(buf + AR5211_EEP_MAC))[5 - i] =
 							((uint8_t *)data)[i];
@@ -1526,25 +1526,12 @@ static bool eep_5211_update_eeprom(struct atheepmgr *aem, int param,
 		return false;
 	}
 
-	/* Store updated data */
-	for (addr = data_pos; addr < (data_pos + data_len); ++addr) {
-		if (!EEP_WRITE(addr, buf[addr])) {
-			fprintf(stderr, "Unable to write EEPROM data at 0x%04x\n",
-				addr);
-			return false;
-		}
-	}
-
 	/* Update checksum if need it */
 	if (data_pos > AR5211_EEP_INFO_BASE) {
 		el = aem->eep_len - AR5211_EEP_INFO_BASE;
 		buf[AR5211_EEP_CSUM] = 0xffff;
 		sum = eep_calc_csum(&buf[AR5211_EEP_INFO_BASE], el);
 		buf[AR5211_EEP_CSUM] = sum;
-		if (!EEP_WRITE(AR5211_EEP_CSUM, sum)) {
-			fprintf(stderr, "Unable to update EEPROM checksum\n");
-			return false;
-		}
 	}
 
 	return true;
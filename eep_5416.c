@@ -46,22 +46,19 @@ static bool eep_5416_load_eeprom(struct atheepmgr *aem, bool raw)
 	uint16_t *buf = aem->eep_buf;
 	int addr;
 
-	/* Check byteswaping requirements for non-RAW operation */
-	if (!raw && !AR5416_TOGGLE_BYTESWAP(5416))
-		return false;
-
 	/* Read to the intermediate buffer */
-	for (addr = 0; addr < AR5416_DATA_START_LOC + AR5416_DATA_SZ; ++addr) {
-		if (!EEP_READ(addr, &buf[addr])) {
-			fprintf(stderr, "Unable to read EEPROM to buffer\n");
-			return false;
-		}
+	if (!EEP_READ_RANGE(0, buf, AR5416_DATA_START_LOC + AR5416_DATA_SZ)) {
+		fprintf(stderr, "Unable to read EEPROM to buffer\n");
+		return false;
 	}
-	aem->eep_len = addr;
+	aem->eep_len = AR5416_DATA_START_LOC + AR5416_DATA_SZ;
 
 	if (raw)	/* Earlier exit on RAW contents loading */
 		return true;
 
+	/* Check byteswaping requirements for non-RAW operation */
+	AR5416_TOGGLE_BYTESWAP(5416);
+
 	/* Copy from buffer to the Init data */
 	for (addr = 0; addr < AR5416_DATA_START_LOC; ++addr)
 		eep_init[addr] = buf[addr];
@@ -527,8 +524,11 @@ static bool eep_5416_update_eeprom(struct atheepmgr *aem, int param,
 	struct eep_5416_priv *emp = aem->eepmap_priv;
 	struct ar5416_eeprom *eep = &emp->eep;
 	uint16_t *buf = aem->eep_buf;
-	int data_pos, data_len = 0, addr, el;
+	int data_pos, data_len = 0, el;
 	uint16_t sum;
+#ifdef CONFIG_I_KNOW_WHAT_I_AM_DOING
+	int addr;
+#endif
 
 	switch (param) {
 	case EEP_UPDATE_MAC:
@@ -577,15 +577,6 @@ static bool eep_5416_update_eeprom(struct atheepmgr *aem, int param,
 		return false;
 	}
 
-	/* Store updated data */
-	for (addr = data_pos; addr < (data_pos + data_len); ++addr) {
-		if (!EEP_WRITE(addr, buf[addr])) {
-			fprintf(stderr, "Unable to write EEPROM data at 0x%04x\n",
-				addr);
-			return false;
-		}
-	}
-
 	/* Update checksum if need it */
 	if (data_pos > AR5416_DATA_START_LOC) {
 		el = eep->baseEepHeader.length / sizeof(uint16_t);
@@ -594,10 +585,6 @@ static bool eep_5416_update_eeprom(struct atheepmgr *aem, int param,
 		buf[AR5416_DATA_CSUM_LOC] = 0xffff;
 		sum = eep_calc_csum(&buf[AR5416_DATA_START_LOC], el);
 		buf[AR5416_DATA_CSUM_LOC] = sum;
-		if (!EEP_WRITE(AR5416_DATA_CSUM_LOC, sum)) {
-			fprintf(stderr, "Unable to update EEPROM checksum\n");
-			return false;
-		}
 	}
 
 	return true;
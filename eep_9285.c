@@ -46,22 +46,19 @@ static bool eep_9285_load_eeprom(struct atheepmgr *aem, bool raw)
 	uint16_t *buf = aem->eep_buf;
 	int addr;
 
-	/* Check byteswaping requirements for non-RAW operation */
-	if (!raw && !AR5416_TOGGLE_BYTESWAP(9285))
-		return false;
-
 	/* Read to the intermediate buffer */
-	for (addr = 0; addr < AR9285_DATA_START_LOC + AR9285_DATA_SZ; ++addr) {
-		if (!EEP_READ(addr, &buf[addr])) {
-			fprintf(stderr, "Unable to read EEPROM to buffer\n");
-			return false;
-		}
+	if (!EEP_READ_RANGE(0, buf, AR9285_DATA_START_LOC + AR9285_DATA_SZ)) {
+		fprintf(stderr, "Unable to read EEPROM to buffer\n");
+		return false;
 	}
-	aem->eep_len = addr;
+	aem->eep_len = AR9285_DATA_START_LOC + AR9285_DATA_SZ;
 
 	if (raw)	/* Earlier exit on RAW contents loading */
 		return true;
 
+	/* Check byteswaping requirements for non-RAW operation */
+	AR5416_TOGGLE_BYTESWAP(9285);
+
 	/* Copy from buffer to the Init data */
 	for (addr = 0; addr < AR9285_DATA_START_LOC; ++addr)
 		eep_init[addr] = buf[addr];
@@ -21,6 +21,8 @@
 #include "eep_9300.h"
 #include "eep_9300_templates.h"
 
+#define AR9300_FETCH_CHUNK	8	/* Lazy fetch granularity, words */
+
 struct eep_9300_priv {
 	int curr_ref_tpl;		/* Current reference EEPROM template */
 	uint8_t unpack_buf[0x800];	/* Unpacking temporary data buffer */
@@ -31,11 +33,18 @@ struct eep_9300_priv {
 		DATA_SRC_OTP,
 	} data_src;			/* Source of data in buffer */
 	int init_data_max_size;		/* Position of data stream finish */
+	int data_base;			/* Position of data stream start */
+	int comp_maj;			/* Version of the first valid block */
+	int comp_min;
 	bool buf_is_be;			/* Is buf 16-bits word in big-endians */
+	bool buf_is_lazy;		/* Is buf filled on demand */
+	/* Lazy filled buf chunks state */
+	bool eep_fetched[AR9300_EEPROM_SIZE / 2 / AR9300_FETCH_CHUNK];
 	struct ar9300_eeprom eep;
 };
 
 #define EEPROM_DATA_LEN_9485	1088
+#define AR9300_COMP_DATA_MAX	1023	/* Max block length accepted by HW */
 
 #define AR9300_TEMPLATE_DESC(__name, __tpl)	\
 	{ ar9300_tpl_ver_ ## __tpl, __name, &ar9300_ ## __tpl }
@@ -68,21 +77,71 @@ static int ar9300_eep2buf(struct atheepmgr *aem, int bytes)
 {
 	int size = (bytes + 1) / 2;	/* Convert to 16 bits words */
 	uint16_t *buf = aem->eep_buf;
-	int addr;
 
-	for (addr = aem->eep_len; addr < size; ++addr) {
-		if (!EEP_READ(addr, &buf[addr])) {
+	if (size <= aem->eep_len)
+		return 0;
+
+	if (!EEP_READ_RANGE(aem->eep_len, &buf[aem->eep_len],
+			    size - aem->eep_len)) {
+		fprintf(stderr, "Unable to read EEPROM to buffer\n");
+		return -1;
+	}
+
+	aem->eep_len = size;
+
+	return 0;
+}
+
+/**
+ * Fetch the specified range of EEPROM words to the internal buffer on demand.
+ * Compressed blocks are usually stored near the EEPROM end and occupy only a
+ * small part of it, so only the words touched by the parser are read. Already
+ * fetched chunks are reused, adjacent missing chunks are read at once.
+ */
+static int ar9300_eep_fetch(struct atheepmgr *aem, int start, int end)
+{
+	struct eep_9300_priv *emp = aem->eepmap_priv;
+	int ch = start / AR9300_FETCH_CHUNK;
+	int last = (end + AR9300_FETCH_CHUNK - 1) / AR9300_FETCH_CHUNK;
+	uint16_t *buf = aem->eep_buf;
+	int run;
+
+	while (ch < last) {
+		if (emp->eep_fetched[ch]) {
+			ch++;
+			continue;
+		}
+		for (run = ch; run < last && !emp->eep_fetched[run]; ++run)
+			emp->eep_fetched[run] = true;
+		if (!EEP_READ_RANGE(ch * AR9300_FETCH_CHUNK,
+				    &buf[ch * AR9300_FETCH_CHUNK],
+				    (run - ch) * AR9300_FETCH_CHUNK)) {
 			fprintf(stderr, "Unable to read EEPROM to buffer\n");
+			while (ch < run)
+				emp->eep_fetched[ch++] = false;
 			return -1;
 		}
+		ch = run;
 	}
 
-	if (addr > aem->eep_len)
-		aem->eep_len = addr;
-
 	return 0;
 }
 
+/**
+ * Count fetched words, just for the statistics.
+ */
+static int ar9300_eep_fetched_len(struct atheepmgr *aem)
+{
+	struct eep_9300_priv *emp = aem->eepmap_priv;
+	int i, n = 0;
+
+	for (i = 0; i < ARRAY_SIZE(emp->eep_fetched); ++i)
+		if (emp->eep_fetched[i])
+			n += AR9300_FETCH_CHUNK;
+
+	return n;
+}
+
 /**
  * Extract bytestream of specified length from the internal buffer as specified
  * offset.
@@ -91,9 +150,12 @@ static int ar9300_eep2buf(struct atheepmgr *aem, int bytes)
  * words. E.g. first two bytes of the output stream are extracted from a word
  * with a specified address, second two bytes of the output stream are extraced
  * from a predcessor word (with a lower address), and so on.
+ *
+ * If the buffer words are in the host endians, then the buffer bytes are
+ * already in the stream order and the whole range is reversed at once.
  */
-static void ar9300_buf2bstr(struct atheepmgr *aem, int addr,
-			    uint8_t *buffer, int count)
+static int ar9300_buf2bstr(struct atheepmgr *aem, int addr,
+			   uint8_t *buffer, int count)
 {
 	struct eep_9300_priv *emp = aem->eepmap_priv;
 	int i;
@@ -101,7 +163,17 @@ static void ar9300_buf2bstr(struct atheepmgr *aem, int addr,
 	if ((addr - count) < 0 || addr / 2  >= aem->eep_len) {
 		fprintf(stderr, "Requested address not in range\n");
 		memset(buffer, 0x00, count);
-		return;
+		return 0;
+	}
+
+	if (emp->buf_is_lazy &&
+	    ar9300_eep_fetch(aem, (addr - count + 1) / 2, addr / 2 + 1) != 0)
+		return -1;
+
+	if (emp->buf_is_be == aem->host_is_be) {
+		memcpy_rev(buffer, (uint8_t *)aem->eep_buf + addr - count + 1,
+			   count);
+		return 0;
 	}
 
 	/*
@@ -117,6 +189,28 @@ static void ar9300_buf2bstr(struct atheepmgr *aem, int addr,
 
 		buffer[addr - i] = aem->eep_buf[i / 2] >> (8 * shift_bytes);
 	}
+
+	return 0;
+}
+
+/**
+ * Put bytestream of specified length to the internal buffer at specified
+ * offset in the reverse direction, exactly as ar9300_buf2bstr() extracts it.
+ */
+static void ar9300_bstr2buf(struct atheepmgr *aem, int addr,
+			    const uint8_t *buffer, int count)
+{
+	struct eep_9300_priv *emp = aem->eepmap_priv;
+	uint16_t *word;
+	int i;
+
+	for (i = addr; i > addr - count; --i) {
+		int shift_bytes = emp->buf_is_be ? (i + 1) % 2 : i % 2;
+
+		word = &aem->eep_buf[i / 2];
+		*word &= ~(0xff << (8 * shift_bytes));
+		*word |= buffer[addr - i] << (8 * shift_bytes);
+	}
 }
 
 /**
@@ -127,19 +221,19 @@ static int ar9300_otp2buf(struct atheepmgr *aem, int bytes)
 {
 	int size = (bytes + 1) & ~0x1;		/* 16-bits alignment */
 	uint8_t *buf = (uint8_t *)aem->eep_buf;	/* Use as an array of bytes */
-	int addr;
+	int addr = aem->eep_len * 2;
 
 	/* NB: buffered data length is in 16-bits words */
 	/* NB: fetch only unavailable portion of data (append buffer) */
-	for (addr = aem->eep_len * 2; addr < size; ++addr) {
-		if (!OTP_READ(addr, &buf[addr])) {
-			fprintf(stderr, "Unable to read OTP to buffer\n");
-			return -1;
-		}
+	if (size <= addr)
+		return 0;
+
+	if (!OTP_READ_BULK(addr, &buf[addr], size - addr)) {
+		fprintf(stderr, "Unable to read OTP to buffer\n");
+		return -1;
 	}
 
-	if (addr > aem->eep_len * 2)
-		aem->eep_len = addr / 2;
+	aem->eep_len = size / 2;
 
 	return 0;
 }
@@ -195,7 +289,8 @@ static int ar9300_process_blocks(struct atheepmgr *aem, int cptr)
 	emp->curr_ref_tpl = -1;	/* Reset reference template */
 
 	for (it = 0; it < MSTATE; it++) {
-		ar9300_buf2bstr(aem, cptr, buf, AR9300_COMP_HDR_LEN);
+		if (ar9300_buf2bstr(aem, cptr, buf, AR9300_COMP_HDR_LEN))
+			return -1;
 
 		if (!ar9300_check_header(buf))
 			break;
@@ -212,8 +307,9 @@ static int ar9300_process_blocks(struct atheepmgr *aem, int cptr)
 			continue;
 		}
 
-		ar9300_buf2bstr(aem, cptr, buf, AR9300_COMP_HDR_LEN +
-				hdr.len + AR9300_COMP_CKSUM_LEN);
+		if (ar9300_buf2bstr(aem, cptr, buf, AR9300_COMP_HDR_LEN +
+				    hdr.len + AR9300_COMP_CKSUM_LEN))
+			return -1;
 
 		checksum = ar9300_comp_cksum(buf + AR9300_COMP_HDR_LEN,
 					     hdr.len);
@@ -232,8 +328,10 @@ static int ar9300_process_blocks(struct atheepmgr *aem, int cptr)
 					       sizeof(emp->eep),
 					       &emp->curr_ref_tpl,
 					       ar9300_template_find_by_id);
-		if (res == 0)
-			valid_blocks++;
+		if (res == 0 && !valid_blocks++) {
+			emp->comp_maj = hdr.maj;
+			emp->comp_min = hdr.min;
+		}
 
 		cptr -= AR9300_COMP_HDR_LEN + hdr.len + AR9300_COMP_CKSUM_LEN;
 	}
@@ -316,6 +414,7 @@ static bool eep_9300_load_eeprom(struct atheepmgr *aem, bool raw)
 	int cptr;
 
 	emp->buf_is_be = false;	/* EEPROM is always in Little-endians */
+	emp->buf_is_lazy = false;
 	aem->eep_len = 0;	/* Reset internal buffer contents */
 
 	if (raw)	/* RAW reading is a bit special case */
@@ -344,10 +443,13 @@ static bool eep_9300_load_eeprom(struct atheepmgr *aem, bool raw)
 	else
 		cptr = AR9300_BASE_ADDR;
 
+	/* Blocks are fetched on demand, the retry reuses fetched data */
+	emp->buf_is_lazy = true;
+	memset(emp->eep_fetched, 0x00, sizeof(emp->eep_fetched));
+	aem->eep_len = (cptr + 1) / 2;
+
 	if (aem->verbose)
 		printf("Trying EEPROM access at Address 0x%04x\n", cptr);
-	if (ar9300_eep2buf(aem, cptr) != 0)
-		return false;
 	if (ar9300_process_blocks(aem, cptr) == 0)
 		goto found;
 
@@ -360,7 +462,11 @@ static bool eep_9300_load_eeprom(struct atheepmgr *aem, bool raw)
 	return false;
 
 found:
+	if (aem->verbose)
+		printf("Fetched %d of %zu EEPROM words\n",
+		       ar9300_eep_fetched_len(aem), aem->eep_len);
 	emp->data_src = DATA_SRC_EEPROM;
+	emp->data_base = cptr;
 	aem->eep_len = (cptr + 1) / 2;	/* Set actual EEPROM size */
 	aem->unpacked_len = sizeof(struct ar9300_eeprom);
 	memcpy(&emp->eep, aem->unpacked_buf, sizeof(emp->eep));
@@ -396,6 +502,7 @@ static bool eep_9300_load_otp(struct atheepmgr *aem, bool raw)
 	int cptr;
 
 	emp->buf_is_be = aem->host_is_be;	/* OTP utilize native-endians */
+	emp->buf_is_lazy = false;
 	aem->eep_len = 0;	/* Reset internal buffer contents */
 
 	if (raw)	/* RAW reading is a bit special case */
@@ -426,6 +533,47 @@ found:
 	return true;
 }
 
+/**
+ * Fetch the rest of the on demand loaded EEPROM contents.
+ */
+static bool eep_9300_fetch_eeprom(struct atheepmgr *aem)
+{
+	struct eep_9300_priv *emp = aem->eepmap_priv;
+
+	if (!emp->buf_is_lazy)
+		return true;
+
+	return ar9300_eep_fetch(aem, 0, aem->eep_len) == 0;
+}
+
+/**
+ * Fetch the chip init data on demand up to the registers list terminator,
+ * since the rest of space before the compressed blocks is usually unused.
+ * Returns the fetched data length in words or -1 on error.
+ */
+static int ar9300_eep_fetch_init(struct atheepmgr *aem)
+{
+	struct eep_9300_priv *emp = aem->eepmap_priv;
+	const struct ar5416_eep_init *ini = (void *)aem->eep_buf;
+	int max = emp->init_data_max_size / 2;
+	int len = 0, i = 0, n;
+
+	while (len < max) {
+		len += AR9300_FETCH_CHUNK;
+		if (len > max)
+			len = max;
+		if (ar9300_eep_fetch(aem, 0, len) != 0)
+			return -1;
+		n = (2 * len - (int)offsetof(typeof(*ini), regs)) /
+		    (int)sizeof(ini->regs[0]);
+		for (; i < n; ++i)
+			if (ini->regs[i].addr == 0xffff)
+				return len;
+	}
+
+	return len;
+}
+
 static bool eep_9300_check(struct atheepmgr *aem)
 {
 	struct eep_9300_priv *emp = aem->eepmap_priv;
@@ -499,8 +647,13 @@ static void eep_9300_dump_init_data(struct atheepmgr *aem)
 		printf("Blob has no chip initialization data\n");
 		printf("\n");
 	} else if (emp->data_src == DATA_SRC_EEPROM) {
+		int len = emp->buf_is_lazy ? ar9300_eep_fetch_init(aem) :
+					     emp->init_data_max_size / 2;
+
+		if (len < 0)
+			return;
 		ar5416_dump_eep_init((struct ar5416_eep_init *)aem->eep_buf,
-				     emp->init_data_max_size / 2);
+				     len);
 	} else if (emp->data_src == DATA_SRC_OTP) {
 		eep_9300_dump_otp_init((struct ar9300_otp_init *)aem->eep_buf,
 				       emp->init_data_max_size);
@@ -842,38 +995,213 @@ static void eep_9300_dump_power_info(struct atheepmgr *aem)
 #undef PR_PWR_CAL
 }
 
+/**
+ * Put the compressed block, followed by the terminator, to the buffer at the
+ * specified offset. Block and terminator should not overlap the chip init
+ * data. Returns the block length or -1 on error.
+ */
+static int ar9300_eep_put_block(struct atheepmgr *aem, int addr,
+				const struct ar9300_comp_hdr *hdr,
+				const uint8_t *data)
+{
+	uint8_t blk[AR9300_COMP_HDR_LEN + AR9300_COMP_DATA_MAX +
+		    AR9300_COMP_CKSUM_LEN];
+	const uint8_t term[AR9300_COMP_HDR_LEN] = {0xff, 0xff, 0xff, 0xff};
+	uint16_t checksum;
+	int blk_len, init_len;
+
+	ar9300_comp_hdr_pack(hdr, blk);
+	memcpy(blk + AR9300_COMP_HDR_LEN, data, hdr->len);
+	checksum = ar9300_comp_cksum(data, hdr->len);
+	blk[AR9300_COMP_HDR_LEN + hdr->len] = checksum & 0xff;
+	blk[AR9300_COMP_HDR_LEN + hdr->len + 1] = checksum >> 8;
+	blk_len = AR9300_COMP_HDR_LEN + hdr->len + AR9300_COMP_CKSUM_LEN;
+
+	init_len = ar9300_eep_fetch_init(aem);
+	if (init_len < 0)
+		return -1;
+	if (addr - blk_len - AR9300_COMP_HDR_LEN < init_len * 2) {
+		if (aem->verbose)
+			printf("No room for %d bytes block at %x\n", blk_len,
+			       addr);
+		return -1;
+	}
+
+	ar9300_bstr2buf(aem, addr, blk, blk_len);
+	ar9300_bstr2buf(aem, addr - blk_len, term, sizeof(term));
+
+	return blk_len;
+}
+
+/**
+ * Compress the unpacked data using the template, which gives the shortest
+ * block, and put the block to the buffer in place of the loaded blocks.
+ */
+static bool ar9300_eep_repack(struct atheepmgr *aem)
+{
+	struct eep_9300_priv *emp = aem->eepmap_priv;
+	const uint8_t *eep = (uint8_t *)&emp->eep;
+	uint8_t data[AR9300_COMP_DATA_MAX], tmp[AR9300_COMP_DATA_MAX];
+	const struct eeptemplate *tpl;
+	struct ar9300_comp_hdr hdr;
+	int len;
+
+	hdr.comp = AR9300_COMP_BLOCK;
+	hdr.len = -1;
+	hdr.maj = emp->comp_maj;
+	hdr.min = emp->comp_min;
+
+	for (tpl = eep_9300_templates; tpl->name; ++tpl) {
+		len = ar9300_compress_block(tmp, hdr.len < 0 ? sizeof(tmp) :
+					    hdr.len - 1, eep, tpl->data,
+					    sizeof(emp->eep));
+		if (len < 0)
+			continue;
+		if (aem->verbose > 1)
+			printf("Template %s gives %d bytes block\n", tpl->name,
+			       len);
+		hdr.ref = tpl->id;
+		hdr.len = len;
+		memcpy(data, tmp, len);
+	}
+	if (hdr.len < 0) {
+		if (aem->verbose)
+			printf("Unable to compress EEPROM data\n");
+		return false;
+	}
+
+	len = ar9300_eep_put_block(aem, emp->data_base, &hdr, data);
+	if (len < 0)
+		return false;
+
+	if (aem->verbose)
+		printf("Repack EEPROM data to %d bytes block, reference %d\n",
+		       len, hdr.ref);
+
+	return true;
+}
+
+/**
+ * Blocks are applied one by one, so put a block, which contains only changes
+ * against the loaded data, below the end of the loaded blocks chain. The block
+ * refers the template 0, which means no template at all, since the driver
+ * resets the data to the template contents for any other reference.
+ */
+static bool ar9300_eep_append(struct atheepmgr *aem,
+			      const struct ar9300_eeprom *old)
+{
+	struct eep_9300_priv *emp = aem->eepmap_priv;
+	uint8_t data[AR9300_COMP_DATA_MAX];
+	struct ar9300_comp_hdr hdr;
+	int len;
+
+	if (emp->curr_ref_tpl < 0)
+		return false;
+
+	len = ar9300_compress_block(data, sizeof(data), (uint8_t *)&emp->eep,
+				    (uint8_t *)old, sizeof(emp->eep));
+	if (len < 0)
+		return false;
+
+	hdr.comp = AR9300_COMP_BLOCK;
+	hdr.ref = 0;
+	hdr.len = len;
+	hdr.maj = emp->comp_maj;
+	hdr.min = emp->comp_min;
+
+	len = ar9300_eep_put_block(aem, emp->init_data_max_size, &hdr, data);
+	if (len < 0)
+		return false;
+
+	if (aem->verbose)
+		printf("Append %d bytes block at %x\n", len,
+		       emp->init_data_max_size);
+
+	return true;
+}
+
+static int ar9300_eep_diff(const uint16_t *a, const uint16_t *b, int len)
+{
+	int i, n = 0;
+
+	for (i = 0; i < len; ++i)
+		if (a[i] != b[i])
+			n++;
+
+	return n;
+}
+
+/**
+ * Pack the updated data back to the buffer either by appending a block with
+ * changes to the loaded blocks chain or by replacing the whole chain with a
+ * single block. The way that changes less EEPROM words is chosen, since each
+ * word write is a slow EEPROM write cycle.
+ */
+static bool ar9300_eep_pack(struct atheepmgr *aem,
+			    const struct ar9300_eeprom *old)
+{
+	size_t sz = aem->eep_len * sizeof(uint16_t);
+	int napp = -1, nrepack = -1;
+	uint16_t *orig;
+
+	orig = malloc(sz);
+	if (!orig) {
+		fprintf(stderr, "Unable to allocate memory for the EEPROM image copy\n");
+		return false;
+	}
+	memcpy(orig, aem->eep_buf, sz);
+
+	if (ar9300_eep_append(aem, old))
+		napp = ar9300_eep_diff(orig, aem->eep_buf, aem->eep_len);
+	memcpy(aem->eep_buf, orig, sz);
+	if (ar9300_eep_repack(aem))
+		nrepack = ar9300_eep_diff(orig, aem->eep_buf, aem->eep_len);
+
+	if (aem->verbose)
+		printf("EEPROM words to change: append %d, repack %d\n", napp,
+		       nrepack);
+
+	if (napp >= 0 && (nrepack < 0 || napp < nrepack)) {
+		memcpy(aem->eep_buf, orig, sz);
+		ar9300_eep_append(aem, old);
+	}
+
+	free(orig);
+
+	if (napp < 0 && nrepack < 0) {
+		fprintf(stderr, "No room for the updated EEPROM data\n");
+		return false;
+	}
+
+	return true;
+}
+
 static bool eep_9300_update_eeprom(struct atheepmgr *aem, int param,
 				   const void *data)
 {
 	struct eep_9300_priv *emp = aem->eepmap_priv;
 	struct ar9300_eeprom *eep = &emp->eep;
-	uint16_t *buf = aem->eep_buf;
-	int data_pos, data_len = 0, addr;
+	struct ar9300_eeprom old = *eep;
 
-	if (emp->data_src != DATA_SRC_BLOB) {
-		fprintf(stderr, "Updation is supported for uncompressed data only\n");
+	if (emp->data_src != DATA_SRC_BLOB &&
+	    emp->data_src != DATA_SRC_EEPROM) {
+		fprintf(stderr, "Updation is supported for EEPROM data only\n");
 		return false;
 	}
 
 	switch (param) {
 	case EEP_UPDATE_MAC:
-		data_pos = EEP_FIELD_OFFSET(macAddr);
-		data_len = EEP_FIELD_SIZE(macAddr);
-		memcpy(&buf[data_pos], data, data_len * sizeof(uint16_t));
+		memcpy(eep->macAddr, data, sizeof(eep->macAddr));
 		break;
 	default:
 		fprintf(stderr, "Internal error: unknown parameter Id\n");
 		return false;
 	}
 
-	/* Store updated data */
-	for (addr = data_pos; addr < (data_pos + data_len); ++addr) {
-		if (!EEP_WRITE(addr, buf[addr])) {
-			fprintf(stderr, "Unable to write EEPROM data at 0x%04x\n",
-				addr);
-			return false;
-		}
-	}
+	if (emp->data_src == DATA_SRC_EEPROM)
+		return ar9300_eep_pack(aem, &old);
+
+	memcpy(aem->eep_buf, eep, sizeof(*eep));
 
 	return true;
 }
@@ -892,6 +1220,7 @@ const struct eepmap eepmap_9300 = {
 	.load_blob = eep_9300_load_blob,
 	.load_eeprom = eep_9300_load_eeprom,
 	.load_otp = eep_9300_load_otp,
+	.fetch_eeprom = eep_9300_fetch_eeprom,
 	.check_eeprom = eep_9300_check,
 	.dump = {
 		[EEP_SECT_INIT] = eep_9300_dump_init_data,
@@ -24,6 +24,8 @@ static const uint8_t eep_9880_otp_magic[2] = {0xaa, 0x55};
 
 struct eep_9880_priv {
 	int curr_ref_tpl;		/* Current reference EEPROM template */
+	bool otp_is_lazy;		/* OTP unused area is not fetched yet */
+	unsigned int otp_fetched;	/* Fetched OTP contents length */
 	struct qca9880_eeprom eep;
 };
 
@@ -107,6 +109,7 @@ static bool eep_9880_load_blob(struct atheepmgr *aem)
 
 	memcpy(&emp->eep, aem->eep_buf, sizeof(emp->eep));
 
+	emp->otp_is_lazy = false;
 	aem->eep_len = (data_size + 1) / 2;
 
 	return true;
@@ -117,32 +120,41 @@ static bool eep_9880_load_otp(struct atheepmgr *aem, bool raw)
 	struct eep_9880_priv *emp = aem->eepmap_priv;
 	struct qca9880_eeprom *eep;
 	uint8_t *buf = (uint8_t *)aem->eep_buf;	/* Use as an array of bytes */
+	unsigned int addr, fetched, n;
 	bool end_mark_seen;
-	unsigned int addr;
 	uint8_t strcode;
 	uint8_t *p, *s;
 
+	emp->otp_is_lazy = false;
+
 	if (!OTP_ENABLE()) {
 		fprintf(stderr, "Unable to enable chip OTP memory access");
 		return false;
 	}
 
-	for (addr = 0; addr < QCA9880_OTP_SIZE; ++addr) {
-		if (!OTP_READ(addr, &buf[addr])) {
-			fprintf(stderr, "Unable to read OTP at 0x%04x\n", addr);
+	if (raw) {	/* Earlier exit on RAW contents loading */
+		if (!OTP_READ_BULK(0, buf, QCA9880_OTP_SIZE)) {
+			fprintf(stderr, "Unable to read OTP\n");
 			goto exit;
 		}
-	}
-
-	if (raw) {	/* Earlier exit on RAW contents loading */
 		aem->eep_len = QCA9880_OTP_SIZE / sizeof(uint16_t);
 		goto exit;
 	}
 
 	/**
 	 * Check OTP magic. Do not have macro to work with big-endian values,
-	 * so check byte by byte.
+	 * so check byte by byte. Magic is located at the OTP end, so fetch it
+	 * first to avoid the whole OTP reading in vain.
 	 */
+	if (!OTP_READ_BULK(QCA9880_OTP_MAGIC_OFFSET,
+			   &buf[QCA9880_OTP_MAGIC_OFFSET],
+			   sizeof(eep_9880_otp_magic)) ||
+	    !OTP_READ_BULK(0, buf, QCA9880_OTP_HEADER_SIZE)) {
+		fprintf(stderr, "Unable to read OTP\n");
+		goto exit;
+	}
+	fetched = QCA9880_OTP_HEADER_SIZE;
+
 	if (memcmp(&buf[QCA9880_OTP_MAGIC_OFFSET], eep_9880_otp_magic,
 	           sizeof(eep_9880_otp_magic)) != 0) {
 		if (aem->verbose > 1)
@@ -181,10 +193,23 @@ static bool eep_9880_load_otp(struct atheepmgr *aem, bool raw)
 	 * for the end marker by checking each next octet of OTP for the
 	 * constant part of the end marker and for variable part (stream code)
 	 * that was extracted from the begin marker.
+	 *
+	 * OTP contents are fetched by chunks while parsing, so the fetching is
+	 * stopped as soon as the parser reaches the unused (zeroed) area.
 	 */
 	strcode = 0xff;
 	s = NULL;	/* Uninit. usage is impossible, but make gcc happy */
 	for (p = buf+QCA9880_OTP_HEADER_SIZE; p < buf+QCA9880_OTP_SIZE; ++p) {
+		if (p == buf + fetched) {
+			n = QCA9880_OTP_SIZE - fetched;
+			if (n > QCA9880_OTP_FETCH_SIZE)
+				n = QCA9880_OTP_FETCH_SIZE;
+			if (!OTP_READ_BULK(fetched, p, n)) {
+				fprintf(stderr, "Unable to read OTP\n");
+				goto exit;
+			}
+			fetched += n;
+		}
 		if (strcode == 0xff) {		/* Not inside OTP stream */
 			if (*p == 0x00)		/* Unused area begin */
 				break;
@@ -230,6 +255,10 @@ static bool eep_9880_load_otp(struct atheepmgr *aem, bool raw)
 		}
 	}
 
+	/* Unused area is fetched on demand, see eep_9880_fetch_eeprom() */
+	emp->otp_is_lazy = fetched < QCA9880_OTP_MAGIC_OFFSET;
+	emp->otp_fetched = fetched;
+
 	/**
 	 * OTP does not contain a checksum correction, so update unpacked
 	 * caldata checksum manually.
@@ -250,6 +279,36 @@ exit:
 	return aem->eep_len != 0;
 }
 
+/**
+ * Fetch the rest of OTP contents, which was skipped by the parser, so the
+ * whole OTP contents could be saved.
+ */
+static bool eep_9880_fetch_eeprom(struct atheepmgr *aem)
+{
+	struct eep_9880_priv *emp = aem->eepmap_priv;
+	uint8_t *buf = (uint8_t *)aem->eep_buf;	/* Use as an array of bytes */
+	bool res;
+
+	if (!emp->otp_is_lazy)
+		return true;
+
+	if (!OTP_ENABLE()) {
+		fprintf(stderr, "Unable to enable chip OTP memory access");
+		return false;
+	}
+
+	res = OTP_READ_BULK(emp->otp_fetched, &buf[emp->otp_fetched],
+			    QCA9880_OTP_MAGIC_OFFSET - emp->otp_fetched);
+	if (res)
+		emp->otp_is_lazy = false;
+	else
+		fprintf(stderr, "Unable to read OTP\n");
+
+	OTP_DISABLE();
+
+	return res;
+}
+
 static bool eep_9880_check(struct atheepmgr *aem)
 {
 	struct eep_9880_priv *emp = aem->eepmap_priv;
@@ -600,6 +659,7 @@ const struct eepmap eepmap_9880 = {
 	.templates = eep_9880_templates,
 	.load_blob = eep_9880_load_blob,
 	.load_otp = eep_9880_load_otp,
+	.fetch_eeprom = eep_9880_fetch_eeprom,
 	.check_eeprom = eep_9880_check,
 	.dump = {
 		[EEP_SECT_BASE] = eep_9880_dump_base_header,
@@ -86,6 +86,7 @@
 
 #define QCA9880_OTP_SIZE			0x0400
 #define QCA9880_OTP_HEADER_SIZE			0x0024
+#define QCA9880_OTP_FETCH_SIZE			0x0080	/* Streaming chunk */
 #define QCA9880_OTP_MAGIC_OFFSET		(QCA9880_OTP_SIZE - 2)
 
 #define QCA9880_OTP_STR_MARK_TYPE_MASK		0xf0
@@ -16,6 +16,8 @@
  */
 
 #include "atheepmgr.h"
+#include "utils.h"
+#include "lzma.h"
 #include "eep_common.h"
 
 const char * const sDeviceType[] = {
@@ -61,22 +63,22 @@ const char * const eep_ctlmodes[] = {
 };
 
 /**
- * Detect possible EEPROM I/O byteswapping and toggle I/O byteswap compensation
- * if need it to consistently load EEPROM data.
+ * Detect possible EEPROM I/O byteswapping using the already fetched EEPROM
+ * contents and toggle I/O byteswap compensation if need it to consistently
+ * load EEPROM data. On toggling the buffered contents are swapped as well,
+ * so the EEPROM should not be read again.
  *
  * NB: all offsets are in 16-bits words
  */
-bool __ar5416_toggle_byteswap(struct atheepmgr *aem, uint32_t eepmisc_off,
+void __ar5416_toggle_byteswap(struct atheepmgr *aem, uint32_t eepmisc_off,
 			      uint32_t binbuildnum_off)
 {
+	const uint16_t *buf = aem->eep_buf;
 	bool magic_is_be;
 	uint16_t word;
 
 	/* First check whether magic is Little-endian or not */
-	if (!EEP_READ(AR5416_EEPROM_MAGIC_OFFSET, &word)) {
-		printf("Toggle EEPROM I/O byteswap compensation\n");
-		return false;
-	}
+	word = buf[AR5416_EEPROM_MAGIC_OFFSET];
 	magic_is_be = word != AR5416_EEPROM_MAGIC;	/* Constant is LE */
 
 	/**
@@ -110,12 +112,8 @@ bool __ar5416_toggle_byteswap(struct atheepmgr *aem, uint32_t eepmisc_off,
 	 *
 	 *  And we will need some more heuristic to solve it (see below).
 	 */
-	if (!EEP_READ(eepmisc_off, &word)) {
-		fprintf(stderr, "EEPROM misc field read failed\n");
-		return false;
-	}
-
-	word &= 0x0101;	/* Clear all except 5GHz and BigEndian bits */
+	/* Clear all except 5GHz and BigEndian bits */
+	word = buf[eepmisc_off] & 0x0101;
 	if (word == 0x0000) {/* Clearly not Big-endian EEPROM */
 		if (!magic_is_be)
 			goto skip_eeprom_io_swap;
@@ -157,12 +155,7 @@ bool __ar5416_toggle_byteswap(struct atheepmgr *aem, uint32_t eepmisc_off,
 	 * endian-agnostic way to detect the byteswapping.
 	 */
 
-	if (!EEP_READ(binbuildnum_off, &word)) {
-		fprintf(stderr, "Calibration software build read failed\n");
-		return false;
-	}
-
-	word = le16toh(word);	/* Just to make a byteorder predictable */
+	word = le16toh(buf[binbuildnum_off]);	/* Make a byteorder predictable */
 
 	/* First we check for byteswapped case */
 	if ((word & 0xff00) == 0 && (word & 0x00ff) != 0)
@@ -186,9 +179,10 @@ toggle_eeprom_io_swap:
 	if (aem->verbose)
 		printf("Toggle EEPROM I/O byteswap compensation\n");
 	aem->eep_io_swap = !aem->eep_io_swap;
+	bswap_16_buf(aem->eep_buf, aem->eep_len);
 
 skip_eeprom_io_swap:
-	return true;
+	return;
 }
 
 /**
@@ -479,6 +473,14 @@ void ar9300_comp_hdr_unpack(const uint8_t *p, struct ar9300_comp_hdr *hdr)
 	hdr->min = value[3] & 0x00ff;
 }
 
+void ar9300_comp_hdr_pack(const struct ar9300_comp_hdr *hdr, uint8_t *p)
+{
+	p[0] = ((hdr->comp & 0x0007) << 5) | (hdr->ref & 0x001f);
+	p[1] = ((hdr->ref & 0x0020) << 2) | ((hdr->len >> 4) & 0x007f);
+	p[2] = ((hdr->len & 0x000f) << 4) | (hdr->maj & 0x000f);
+	p[3] = hdr->min & 0x00ff;
+}
+
 uint16_t ar9300_comp_cksum(const uint8_t *data, int dsize)
 {
 	int it, checksum = 0;
@@ -525,12 +527,121 @@ static bool ar9300_uncompress_block(struct atheepmgr *aem, uint8_t *out,
 	return true;
 }
 
+/**
+ * Restore data from the (offset, value) pairs, where the offset is counted
+ * from the byte next to the previously restored one.
+ */
+static bool ar9300_uncompress_pairs(struct atheepmgr *aem, uint8_t *out,
+				    int out_size, const uint8_t *in, int in_len)
+{
+	int it, spot = 0;
+
+	if (in_len % 2) {
+		fprintf(stderr, "Bad pairs data length %d\n", in_len);
+		return false;
+	}
+
+	for (it = 0; it < in_len; it += 2) {
+		spot += in[it];
+		if (spot >= out_size) {
+			fprintf(stderr, "Bad restore at %d: spot=%d offset=%d\n",
+				it, spot, in[it]);
+			return false;
+		}
+		out[spot++] = in[it + 1];
+	}
+
+	if (aem->verbose)
+		printf("Restored %d pairs\n", in_len / 2);
+
+	return true;
+}
+
+/**
+ * Reset the output to the reference data if the block refers another data
+ * than the current output contains.
+ */
+static int ar9300_comp_load_ref(struct ar9300_comp_hdr *hdr, uint8_t *out,
+				int out_size, int *pcurrref,
+				const uint8_t *(*tpl_lookup_cb)(int))
+{
+	const uint8_t *tpl;
+
+	/* Reference 0 means apply the block on top of the current data */
+	if (hdr->ref == 0 || hdr->ref == *pcurrref)
+		return 0;
+
+	tpl = tpl_lookup_cb(hdr->ref);
+	if (tpl == NULL) {
+		fprintf(stderr, "can't find reference eeprom struct %d\n",
+			hdr->ref);
+		return -1;
+	}
+	memcpy(out, tpl, out_size);
+	*pcurrref = hdr->ref;
+
+	return 0;
+}
+
+/**
+ * Encode the data as a sequence of runs, which differ from the reference data,
+ * to be restored by ar9300_uncompress_block(). Each run is prepended with the
+ * offset from the previous run end and the run length, so runs separated by a
+ * gap of up to two bytes are merged. Returns the encoded data length or -1 if
+ * it does not fit into the output buffer.
+ */
+int ar9300_compress_block(uint8_t *out, int out_size, const uint8_t *data,
+			  const uint8_t *ref, int size)
+{
+	int pos = 0, spot = 0, start, end, gap, offset, length;
+
+	while (1) {
+		for (start = spot; start < size; ++start)
+			if (data[start] != ref[start])
+				break;
+		if (start == size)
+			break;
+
+		for (end = start, gap = 0; end + gap < size && gap <= 2;) {
+			if (data[end + gap] != ref[end + gap]) {
+				end += gap + 1;
+				gap = 0;
+			} else {
+				gap++;
+			}
+		}
+
+		offset = start - spot;
+		while (offset > 0xff) {	/* Skip with empty runs */
+			if (pos + 2 > out_size)
+				return -1;
+			out[pos++] = 0xff;
+			out[pos++] = 0;
+			offset -= 0xff;
+		}
+
+		for (spot = start; spot < end; spot += length, offset = 0) {
+			length = end - spot > 0xff ? 0xff : end - spot;
+			if (pos + 2 + length > out_size)
+				return -1;
+			out[pos++] = offset;
+			out[pos++] = length;
+			memcpy(&out[pos], &data[spot], length);
+			pos += length;
+		}
+	}
+
+	return pos;
+}
+
 int ar9300_compress_decision(struct atheepmgr *aem, int it,
 			     struct ar9300_comp_hdr *hdr, uint8_t *out,
 			     const uint8_t *data, int out_size, int *pcurrref,
 			     const uint8_t *(*tpl_lookup_cb)(int))
 {
+	uint8_t *tmp;
 	bool res;
+	int len;
 
 	switch (hdr->comp) {
 	case AR9300_COMP_NONE:
@@ -547,19 +658,9 @@ int ar9300_compress_decision(struct atheepmgr *aem, int it,
 		break;
 
 	case AR9300_COMP_BLOCK:
-		if (hdr->ref != *pcurrref) {
-			const uint8_t *tpl;
-
-			tpl = tpl_lookup_cb(hdr->ref);
-			if (tpl == NULL) {
-				fprintf(stderr,
-					"can't find reference eeprom struct %d\n",
-					hdr->ref);
-				return -1;
-			}
-			memcpy(out, tpl, out_size);
-			*pcurrref = hdr->ref;
-		}
+		if (ar9300_comp_load_ref(hdr, out, out_size, pcurrref,
+					 tpl_lookup_cb))
+			return -1;
 		if (aem->verbose)
 			printf("Restore eeprom %d: block, reference %d, length %d\n",
 			       it, hdr->ref, hdr->len);
@@ -569,6 +670,43 @@ int ar9300_compress_decision(struct atheepmgr *aem, int it,
 			return -1;
 		break;
 
+	case AR9300_COMP_PAIRS:
+		if (ar9300_comp_load_ref(hdr, out, out_size, pcurrref,
+					 tpl_lookup_cb))
+			return -1;
+		if (aem->verbose)
+			printf("Restore eeprom %d: pairs, reference %d, length %d\n",
+			       it, hdr->ref, hdr->len);
+		res = ar9300_uncompress_pairs(aem, out, out_size,
+					      data, hdr->len);
+		if (!res)
+			return -1;
+		break;
+
+	case AR9300_COMP_LZMA:
+		/* Decode to a temporary buffer to keep output on error */
+		tmp = malloc(out_size);
+		if (!tmp) {
+			fprintf(stderr, "Unable to allocate LZMA output buffer\n");
+			return -1;
+		}
+		len = lzma_decode(tmp, out_size, data, hdr->len);
+		if (len == out_size)
+			memcpy(out, tmp, out_size);
+		free(tmp);
+		if (len != out_size) {
+			fprintf(stderr,
+				"LZMA decompression failed, got %d bytes of %d\n",
+				len, out_size);
+			return -1;
+		}
+		/* Whole data is restored, next blocks could refer it */
+		*pcurrref = hdr->ref;
+		if (aem->verbose)
+			printf("Restore eeprom %d: lzma, length %d\n",
+			       it, hdr->len);
+		break;
+
 	default:
 		fprintf(stderr, "unknown compression code %d\n", hdr->comp);
 		return -1;
@@ -184,7 +184,7 @@ struct ar5416_cal_target_power {
  * different offsets within a base header and (or) different start position of
  * the main data within EEPROM. So use macro to overcome offset differences.
  */
-bool __ar5416_toggle_byteswap(struct atheepmgr *aem, uint32_t eepmisc_off,
+void __ar5416_toggle_byteswap(struct atheepmgr *aem, uint32_t eepmisc_off,
 			      uint32_t binbuildnum_off);
 #define AR5416_TOGGLE_BYTESWAP(__chip)					\
 	__ar5416_toggle_byteswap(aem,					\
@@ -215,7 +215,10 @@ void ar5416_dump_ctl(const uint8_t *index,
 		(sizeof(eep->__field) / sizeof(uint16_t))
 
 void ar9300_comp_hdr_unpack(const uint8_t *p, struct ar9300_comp_hdr *hdr);
+void ar9300_comp_hdr_pack(const struct ar9300_comp_hdr *hdr, uint8_t *p);
 uint16_t ar9300_comp_cksum(const uint8_t *data, int dsize);
+int ar9300_compress_block(uint8_t *out, int out_size, const uint8_t *data,
+			  const uint8_t *ref, int size);
 int ar9300_compress_decision(struct atheepmgr *aem, int it,
 			     struct ar9300_comp_hdr *hdr, uint8_t *out,
 			     const uint8_t *data, int out_size, int *pcurrref,
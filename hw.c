@@ -15,7 +15,10 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <time.h>
+
 #include "atheepmgr.h"
+#include "utils.h"
 #include "hw.h"
 
 static struct {
@@ -123,24 +126,269 @@ static void hw_read_revisions(struct atheepmgr *aem)
 	}
 }
 
+uint64_t hw_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Poll the register until the masked value becomes equal to the expected one
+ * or the timeout (in us) expires. The last polled register value is returned
+ * via the status argument (if any) for the further error checking.
+ *
+ * Most operations complete in a few microseconds, while the real sleep
+ * granularity is usually 50-100 us, so busy spin for a short time, then
+ * fallback to sleeping with an exponential backoff. The connector could
+ * request pure spinning (fast direct reg access) or pure sleeping (each reg
+ * access is a slow syscall anyway).
+ */
+bool hw_wait_status(struct atheepmgr *aem, uint32_t reg, uint32_t mask,
+		    uint32_t val, uint32_t timeout, uint32_t *status)
+{
+	enum con_wait_strategy strategy = aem->con->wait;
+	uint64_t start = hw_now_us(), now, deadline = start + timeout;
+	unsigned int delay = AH_TIME_QUANTUM;
+	bool res = false;
+	uint32_t st;
+
+	aem->wait_stats.waits++;
+
+	if (aem->deadline) {
+		if (start >= aem->deadline) {
+			if (!aem->deadline_expired)
+				fprintf(stderr, "Operation deadline expired, giving up\n");
+			aem->deadline_expired = true;
+			aem->wait_stats.timeouts++;
+			return false;
+		}
+		if (deadline > aem->deadline)
+			deadline = aem->deadline;
+	}
+
+	for (;;) {
+		aem->wait_stats.polls++;
+		st = REG_READ(reg);
+		if (status)
+			*status = st;
+		if ((st & mask) == val) {
+			res = true;
+			break;
+		}
+
+		now = hw_now_us();
+		if (now >= deadline)
+			break;
+
+		if (strategy == CON_WAIT_SPIN ||
+		    (strategy == CON_WAIT_ADAPTIVE &&
+		     now - start < AH_WAIT_SPIN_TIME))
+			continue;
+
+		usleep(delay < deadline - now ? delay : deadline - now);
+		if (delay < AH_WAIT_SLEEP_MAX)
+			delay *= 2;
+	}
+
+	if (!res)
+		aem->wait_stats.timeouts++;
+	aem->wait_stats.time += hw_now_us() - start;
+
+	return res;
+}
+
 bool hw_wait(struct atheepmgr *aem, uint32_t reg, uint32_t mask,
 	     uint32_t val, uint32_t timeout)
 {
-	int i;
+	return hw_wait_status(aem, reg, mask, val, timeout, NULL);
+}
+
+/**
+ * Limit the total time of the hardware status waiting, timeout is in ms. Only
+ * the waiter and the engines health check honor it, register accesses and the
+ * connector I/O themselves are not interrupted.
+ */
+void hw_deadline_set(struct atheepmgr *aem, unsigned long timeout)
+{
+	aem->deadline = hw_now_us() + (uint64_t)timeout * 1000;
+}
+
+/**
+ * A wedged card fails each operation only after the full timeout, so track
+ * consecutive timeouts of the EEPROM and OTP engines and fail all further
+ * operations immediately once the engine is considered dead.
+ */
+static bool hw_health_ok(struct atheepmgr *aem, struct hw_health *health)
+{
+	return !health->dead && !aem->deadline_expired;
+}
+
+static void hw_health_update(struct atheepmgr *aem, struct hw_health *health,
+			     const char *name, bool res,
+			     unsigned long timeouts)
+{
+	if (res) {
+		health->timeouts = 0;
+		return;
+	}
 
-	for (i = 0; i < (timeout / AH_TIME_QUANTUM); i++) {
-		if ((REG_READ(reg) & mask) == val)
-			return true;
+	if (aem->wait_stats.timeouts == timeouts)	/* Not a timeout */
+		return;
 
-		usleep(AH_TIME_QUANTUM);
+	if (++health->timeouts < AH_DEAD_TIMEOUTS || health->dead)
+		return;
+
+	health->dead = true;
+	fprintf(stderr, "%s is not responding, giving up\n", name);
+}
+
+bool hw_is_dead(struct atheepmgr *aem)
+{
+	return aem->eep_health.dead || aem->otp_health.dead ||
+	       aem->deadline_expired;
+}
+
+void hw_reg_read_bulk(struct atheepmgr *aem, uint32_t reg, uint32_t *buf,
+		      unsigned int cnt)
+{
+	if (aem->con->reg_read_bulk) {
+		aem->con->reg_read_bulk(aem, reg, buf, cnt);
+		return;
 	}
 
-	return false;
+	for (; cnt; --cnt, reg += sizeof(uint32_t))
+		*buf++ = REG_READ(reg);
+}
+
+void hw_reg_write_bulk(struct atheepmgr *aem, uint32_t reg,
+		       const uint32_t *buf, unsigned int cnt)
+{
+	if (aem->con->reg_write_bulk) {
+		aem->con->reg_write_bulk(aem, reg, buf, cnt);
+		return;
+	}
+
+	for (; cnt; --cnt, reg += sizeof(uint32_t))
+		REG_WRITE(reg, *buf++);
+}
+
+/**
+ * Control registers (e.g. GPIO mux and direction) are not changed by the
+ * hardware itself, so keep a write-through shadow of such registers to avoid
+ * reading them back on each RMW operation, what is costly for some connectors.
+ */
+static void hw_reg_shadow_declare(struct atheepmgr *aem, uint32_t reg)
+{
+	struct hw_reg_shadow *shadow;
+
+	if (aem->reg_shadow_num >= ARRAY_SIZE(aem->reg_shadow))
+		return;
+
+	shadow = &aem->reg_shadow[aem->reg_shadow_num++];
+	shadow->reg = reg;
+	shadow->valid = false;
+}
+
+static struct hw_reg_shadow *hw_reg_shadow_find(struct atheepmgr *aem,
+						uint32_t reg)
+{
+	unsigned i;
+
+	for (i = 0; i < aem->reg_shadow_num; ++i)
+		if (aem->reg_shadow[i].reg == reg)
+			return &aem->reg_shadow[i];
+
+	return NULL;
+}
+
+static void hw_reg_shadow_write(struct atheepmgr *aem, uint32_t reg,
+				uint32_t val)
+{
+	struct hw_reg_shadow *shadow = hw_reg_shadow_find(aem, reg);
+
+	REG_WRITE(reg, val);
+
+	if (shadow) {
+		shadow->val = val;
+		shadow->valid = true;
+	}
+}
+
+static void hw_reg_shadow_rmw(struct atheepmgr *aem, uint32_t reg,
+			      uint32_t set, uint32_t clr)
+{
+	struct hw_reg_shadow *shadow = hw_reg_shadow_find(aem, reg);
+	uint32_t val;
+
+	if (!shadow) {
+		REG_RMW(reg, set, clr);
+		return;
+	}
+
+	val = shadow->valid ? shadow->val : REG_READ(reg);
+	val &= ~clr;
+	val |= set;
+	hw_reg_shadow_write(aem, reg, val);
+}
+
+void hw_reg_shadow_invalidate(struct atheepmgr *aem)
+{
+	unsigned i;
+
+	for (i = 0; i < aem->reg_shadow_num; ++i)
+		aem->reg_shadow[i].valid = false;
+}
+
+/**
+ * GPIO state is spread over a few adjacent registers, which are read over
+ * and over again for each line during the state dumping. So take a snapshot
+ * of the whole block at once and serve the state requests from it. Each
+ * call retakes the snapshot, disabling it returns to the registers access.
+ */
+void hw_gpio_snapshot(struct atheepmgr *aem, bool enable)
+{
+	aem->gpio_snap_cnt = 0;
+	if (!enable || !aem->gpio || !aem->gpio->snapshot)
+		return;
+
+	aem->gpio->snapshot(aem);
+}
+
+static void hw_gpio_snapshot_range(struct atheepmgr *aem, uint32_t start,
+				   uint32_t end)
+{
+	unsigned cnt = (end - start) / sizeof(uint32_t) + 1;
+
+	if (cnt > ARRAY_SIZE(aem->gpio_snap))
+		return;		/* Should not happen, fallback to the regs */
+
+	aem->gpio_snap_base = start;
+	REG_READ_BULK(start, aem->gpio_snap, cnt);
+	aem->gpio_snap_cnt = cnt;
+}
+
+static uint32_t hw_gpio_reg_read(struct atheepmgr *aem, uint32_t reg)
+{
+	uint32_t idx = (reg - aem->gpio_snap_base) / sizeof(uint32_t);
+
+	if (reg >= aem->gpio_snap_base && idx < aem->gpio_snap_cnt)
+		return aem->gpio_snap[idx];
+
+	return REG_READ(reg);
+}
+
+static void hw_gpio_snapshot_ar9xxx(struct atheepmgr *aem)
+{
+	hw_gpio_snapshot_range(aem, AR9XXX_GPIO_IN_OUT,
+			       AR9XXX_GPIO_OUTPUT_MUX3);
 }
 
 static int hw_gpio_input_get_ar9xxx(struct atheepmgr *aem, unsigned gpio)
 {
-	uint32_t regval = REG_READ(AR9XXX_GPIO_IN_OUT);
+	uint32_t regval = hw_gpio_reg_read(aem, AR9XXX_GPIO_IN_OUT);
 
 	if (gpio >= aem->gpio_num)
 		return 0;
@@ -164,7 +412,7 @@ static int hw_gpio_output_get_ar9xxx(struct atheepmgr *aem, unsigned gpio)
 	if (gpio >= aem->gpio_num)
 		return 0;
 
-	return !!(REG_READ(AR9XXX_GPIO_IN_OUT) & BIT(gpio));
+	return !!(hw_gpio_reg_read(aem, AR9XXX_GPIO_IN_OUT) & BIT(gpio));
 }
 
 static void hw_gpio_output_set_ar9xxx(struct atheepmgr *aem, unsigned gpio,
@@ -188,12 +436,14 @@ static int hw_gpio_out_mux_get_ar9xxx(struct atheepmgr *aem, unsigned gpio)
 	else
 		reg = AR9XXX_GPIO_OUTPUT_MUX1;
 
-	return (REG_READ(reg) >> sh) & AR9XXX_GPIO_OUTPUT_MUX_MASK;
+	return (hw_gpio_reg_read(aem, reg) >> sh) &
+	       AR9XXX_GPIO_OUTPUT_MUX_MASK;
 }
 
 static void hw_gpio_out_mux_set_ar9xxx(struct atheepmgr *aem, unsigned gpio,
 				       int type)
 {
+	struct hw_reg_shadow *shadow;
 	uint32_t reg, tmp;
 	unsigned sh = (gpio % 6) * 5;
 
@@ -209,13 +459,20 @@ static void hw_gpio_out_mux_set_ar9xxx(struct atheepmgr *aem, unsigned gpio,
 
 	if (AR_SREV_9280_20_OR_LATER(aem) ||
 	    reg != AR9XXX_GPIO_OUTPUT_MUX1) {
-		REG_RMW(reg, type << sh, AR9XXX_GPIO_OUTPUT_MUX_MASK << sh);
+		hw_reg_shadow_rmw(aem, reg, type << sh,
+				  AR9XXX_GPIO_OUTPUT_MUX_MASK << sh);
 	} else {
-		tmp = REG_READ(reg);
-		tmp = ((tmp & 0x1f0) << 1) | (tmp & ~0x1f0);
+		/* Read value layout differs, shadow keeps the written one */
+		shadow = hw_reg_shadow_find(aem, reg);
+		if (shadow && shadow->valid) {
+			tmp = shadow->val;
+		} else {
+			tmp = REG_READ(reg);
+			tmp = ((tmp & 0x1f0) << 1) | (tmp & ~0x1f0);
+		}
 		tmp &= ~(AR9XXX_GPIO_OUTPUT_MUX_MASK << sh);
 		tmp |= type << sh;
-		REG_WRITE(reg, tmp);
+		hw_reg_shadow_write(aem, reg, tmp);
 	}
 }
 
@@ -247,7 +504,8 @@ static int hw_gpio_dir_get_ar9xxx(struct atheepmgr *aem, unsigned gpio)
 	if (gpio >= aem->gpio_num)
 		return -1;
 
-	return (REG_READ(AR9XXX_GPIO_OE_OUT) >> sh) & AR9XXX_GPIO_OE_OUT_DRV;
+	return (hw_gpio_reg_read(aem, AR9XXX_GPIO_OE_OUT) >> sh) &
+	       AR9XXX_GPIO_OE_OUT_DRV;
 }
 
 static void hw_gpio_dir_set_out_ar9xxx(struct atheepmgr *aem, unsigned gpio)
@@ -259,7 +517,7 @@ static void hw_gpio_dir_set_out_ar9xxx(struct atheepmgr *aem, unsigned gpio)
 
 	hw_gpio_out_mux_set_ar9xxx(aem, gpio, AR9XXX_GPIO_OUTPUT_MUX_OUTPUT);
 
-	REG_RMW(AR9XXX_GPIO_OE_OUT,
+	hw_reg_shadow_rmw(aem, AR9XXX_GPIO_OE_OUT,
 		AR9XXX_GPIO_OE_OUT_DRV_ALL << sh,
 		AR9XXX_GPIO_OE_OUT_DRV << sh);
 }
@@ -284,6 +542,7 @@ static const char *hw_gpio_dir_get_str_ar9xxx(struct atheepmgr *aem,
 }
 
 static const struct gpio_ops gpio_ops_ar9xxx = {
+	.snapshot = hw_gpio_snapshot_ar9xxx,
 	.input_get = hw_gpio_input_get_ar9xxx,
 	.output_get = hw_gpio_output_get_ar9xxx,
 	.output_set = hw_gpio_output_set_ar9xxx,
@@ -332,12 +591,17 @@ static bool hw_eeprom_write_9xxx(struct atheepmgr *aem, uint32_t off,
 #undef WAIT_MASK
 }
 
+static void hw_gpio_snapshot_ar5xxx(struct atheepmgr *aem)
+{
+	hw_gpio_snapshot_range(aem, AR5XXX_GPIO_CTRL, AR5XXX_GPIO_IN);
+}
+
 static int hw_gpio_input_get_ar5xxx(struct atheepmgr *aem, unsigned gpio)
 {
 	if (gpio >= aem->gpio_num)
 		return 0;
 
-	return !!(REG_READ(AR5XXX_GPIO_IN) & BIT(gpio));
+	return !!(hw_gpio_reg_read(aem, AR5XXX_GPIO_IN) & BIT(gpio));
 }
 
 static int hw_gpio_output_get_ar5xxx(struct atheepmgr *aem, unsigned gpio)
@@ -345,13 +609,13 @@ static int hw_gpio_output_get_ar5xxx(struct atheepmgr *aem, unsigned gpio)
 	if (gpio >= aem->gpio_num)
 		return 0;
 
-	return !!(REG_READ(AR5XXX_GPIO_OUT) & BIT(gpio));
+	return !!(hw_gpio_reg_read(aem, AR5XXX_GPIO_OUT) & BIT(gpio));
 }
 
 static void hw_gpio_output_set_ar5xxx(struct atheepmgr *aem, unsigned gpio,
 				      int val)
 {
-	REG_RMW(AR5XXX_GPIO_OUT, !!val << gpio, 1 << gpio);
+	hw_reg_shadow_rmw(aem, AR5XXX_GPIO_OUT, !!val << gpio, 1 << gpio);
 }
 
 static int hw_gpio_dir_get_ar5xxx(struct atheepmgr *aem, unsigned gpio)
@@ -361,7 +625,8 @@ static int hw_gpio_dir_get_ar5xxx(struct atheepmgr *aem, unsigned gpio)
 	if (gpio >= aem->gpio_num)
 		return 0;
 
-	return (REG_READ(AR5XXX_GPIO_CTRL) >> sh) & AR5XXX_GPIO_CTRL_DRV;
+	return (hw_gpio_reg_read(aem, AR5XXX_GPIO_CTRL) >> sh) &
+	       AR5XXX_GPIO_CTRL_DRV;
 }
 
 static void hw_gpio_dir_set_out_ar5xxx(struct atheepmgr *aem, unsigned gpio)
@@ -371,7 +636,7 @@ static void hw_gpio_dir_set_out_ar5xxx(struct atheepmgr *aem, unsigned gpio)
 	if (gpio >= aem->gpio_num)
 		return;
 
-	REG_RMW(AR5XXX_GPIO_CTRL,
+	hw_reg_shadow_rmw(aem, AR5XXX_GPIO_CTRL,
 		AR5XXX_GPIO_CTRL_DRV_ALL << sh,
 		AR5XXX_GPIO_CTRL_DRV << sh);
 }
@@ -396,6 +661,7 @@ static const char *hw_gpio_dir_get_str_ar5xxx(struct atheepmgr *aem,
 }
 
 static const struct gpio_ops gpio_ops_ar5xxx = {
+	.snapshot = hw_gpio_snapshot_ar5xxx,
 	.input_get = hw_gpio_input_get_ar5xxx,
 	.output_get = hw_gpio_output_get_ar5xxx,
 	.output_set = hw_gpio_output_set_ar5xxx,
@@ -403,24 +669,28 @@ static const struct gpio_ops gpio_ops_ar5xxx = {
 	.dir_get_str = hw_gpio_dir_get_str_ar5xxx,
 };
 
-static bool hw_eeprom_read_5211(struct atheepmgr *aem, uint32_t off, uint16_t *data)
+/**
+ * Wait for the AR5211 EEPROM command completion and check its error status.
+ */
+static bool hw_eeprom_wait_5211(struct atheepmgr *aem, uint32_t done,
+				uint32_t err)
 {
-	static const uint32_t wait_to = AH_WAIT_TIMEOUT;
-	uint32_t to, st;
+	uint32_t st;
 
+	if (!hw_wait_status(aem, AR5211_EEPROM_STATUS, done, done,
+			    AH_WAIT_TIMEOUT, &st))
+		return false;
+
+	return !(st & err);
+}
+
+static bool hw_eeprom_read_5211(struct atheepmgr *aem, uint32_t off, uint16_t *data)
+{
 	REG_WRITE(AR5211_EEPROM_ADDR, off);
 	REG_WRITE(AR5211_EEPROM_CMD, AR5211_EEPROM_CMD_READ);
 
-	for (to = 0; to < wait_to; ++to) {
-		st = REG_READ(AR5211_EEPROM_STATUS);
-		if (st & AR5211_EEPROM_STATUS_READ_COMPLETE) {
-			if (st & AR5211_EEPROM_STATUS_READ_ERROR)
-				return false;
-			break;
-		}
-		usleep(AH_TIME_QUANTUM);
-	}
-	if (wait_to == to)
+	if (!hw_eeprom_wait_5211(aem, AR5211_EEPROM_STATUS_READ_COMPLETE,
+				 AR5211_EEPROM_STATUS_READ_ERROR))
 		return false;
 
 	*data = REG_READ(AR5211_EEPROM_DATA) & 0xffff;
@@ -430,26 +700,12 @@ static bool hw_eeprom_read_5211(struct atheepmgr *aem, uint32_t off, uint16_t *d
 
 static bool hw_eeprom_write_5211(struct atheepmgr *aem, uint32_t off, uint16_t data)
 {
-	static const uint32_t wait_to = AH_WAIT_TIMEOUT;
-	uint32_t to, st;
-
 	REG_WRITE(AR5211_EEPROM_ADDR, off);
 	REG_WRITE(AR5211_EEPROM_DATA, data);
 	REG_WRITE(AR5211_EEPROM_CMD, AR5211_EEPROM_CMD_WRITE);
 
-	for (to = 0; to < wait_to; ++to) {
-		st = REG_READ(AR5211_EEPROM_STATUS);
-		if (st & AR5211_EEPROM_STATUS_WRITE_COMPLETE) {
-			if (st & AR5211_EEPROM_STATUS_WRITE_ERROR)
-				return false;
-			break;
-		}
-		usleep(AH_TIME_QUANTUM);
-	}
-	if (wait_to == to)
-		return false;
-
-	return true;
+	return hw_eeprom_wait_5211(aem, AR5211_EEPROM_STATUS_WRITE_COMPLETE,
+				   AR5211_EEPROM_STATUS_WRITE_ERROR);
 }
 
 static void hw_eeprom_lock_gpio(struct atheepmgr *aem, int lock)
@@ -518,43 +774,102 @@ static bool hw_otp_read_988x(struct atheepmgr *aem, uint32_t off, uint8_t *data)
 	return true;
 }
 
+/**
+ * Each OTP octet is mapped to its own register, so fetch registers in chunks
+ * and pick the octets up from them.
+ */
+static bool hw_otp_read_bulk_988x(struct atheepmgr *aem, uint32_t off,
+				  uint8_t *buf, unsigned int len)
+{
+	uint32_t regs[0x100];
+	unsigned int i, n;
+
+	while (len) {
+		n = len < ARRAY_SIZE(regs) ? len : ARRAY_SIZE(regs);
+		REG_READ_BULK(QCA988X_OTP_DATA + 4 * off, regs, n);
+		for (i = 0; i < n; ++i)
+			buf[i] = regs[i];
+		off += n;
+		buf += n;
+		len -= n;
+	}
+
+	return true;
+}
+
 static const struct otp_ops hw_otp_988x = {
 	.enable = hw_otp_enable_988x,
 	.read = hw_otp_read_988x,
+	.read_bulk = hw_otp_read_bulk_988x,
 };
 
 /**
- * Chip reads OTP by 32-bits words. We cache readed word value and return
- * cached data if user request octet from a same word. Such caching greatly (x4)
- * increase sequent reading.
+ * Chip reads OTP by 32-bits words, each word read is a separate transaction
+ * with the status polling. So fetch the whole requested range of words to the
+ * per-session cache and serve subsequent octet requests from it.
  */
-static bool hw_otp_read_93xx(struct atheepmgr *aem, uint32_t off, uint8_t *data)
+static bool hw_otp_fill_93xx(struct atheepmgr *aem, uint32_t off,
+			     unsigned int len)
 {
-	static uint32_t prev_word_addr = ~0;
-	static uint32_t prev_word_data;
-	uint32_t word_addr = off & ~0x3;	/* 32-bits alignment */
-	int shift = (off % 4) * 8;
+	uint32_t start = off & ~0x3;		/* 32-bits alignment */
+	uint32_t addr, val;
 
-	if (word_addr == prev_word_addr)
-		goto data_return;	/* Serve from cache */
+	len = (off + len - start + 3) & ~0x3;
+	if (len > sizeof(aem->otp_cache))
+		len = sizeof(aem->otp_cache);
 
-	REG_READ(AR9300_OTP_BASE + word_addr);
+	aem->otp_cache_len = 0;
+	aem->otp_cache_off = start;
 
-	if (!hw_wait(aem, AR9300_OTP_STATUS, AR9300_OTP_STATUS_TYPE,
-		     AR9300_OTP_STATUS_VALID, 1000))
-		return false;
+	for (addr = 0; addr < len; addr += 4) {
+		REG_READ(AR9300_OTP_BASE + start + addr);
+
+		if (!hw_wait(aem, AR9300_OTP_STATUS, AR9300_OTP_STATUS_TYPE,
+			     AR9300_OTP_STATUS_VALID, 1000))
+			return false;
+
+		val = REG_READ(AR9300_OTP_READ_DATA);
+		aem->otp_cache[addr + 0] = val >> 0;
+		aem->otp_cache[addr + 1] = val >> 8;
+		aem->otp_cache[addr + 2] = val >> 16;
+		aem->otp_cache[addr + 3] = val >> 24;
+		aem->otp_cache_len = addr + 4;
+	}
 
-	prev_word_addr = word_addr;
-	prev_word_data = REG_READ(AR9300_OTP_READ_DATA);
+	return true;
+}
+
+static bool hw_otp_read_bulk_93xx(struct atheepmgr *aem, uint32_t off,
+				  uint8_t *buf, unsigned int len)
+{
+	unsigned int n;
 
-data_return:
-	*data = prev_word_data >> shift;
+	while (len) {
+		if (off < aem->otp_cache_off ||
+		    off >= aem->otp_cache_off + aem->otp_cache_len) {
+			if (!hw_otp_fill_93xx(aem, off, len))
+				return false;
+		}
+		n = aem->otp_cache_off + aem->otp_cache_len - off;
+		if (n > len)
+			n = len;
+		memcpy(buf, &aem->otp_cache[off - aem->otp_cache_off], n);
+		off += n;
+		buf += n;
+		len -= n;
+	}
 
 	return true;
 }
 
+static bool hw_otp_read_93xx(struct atheepmgr *aem, uint32_t off, uint8_t *data)
+{
+	return hw_otp_read_bulk_93xx(aem, off, data, 1);
+}
+
 static const struct otp_ops hw_otp_93xx = {
 	.read = hw_otp_read_93xx,
+	.read_bulk = hw_otp_read_bulk_93xx,
 };
 
 void hw_eeprom_set_ops(struct atheepmgr *aem)
@@ -581,7 +896,15 @@ void hw_eeprom_set_ops(struct atheepmgr *aem)
 
 bool hw_eeprom_read(struct atheepmgr *aem, uint32_t off, uint16_t *data)
 {
-	if (!aem->eep || !aem->eep->read(aem, off, data))
+	unsigned long timeouts = aem->wait_stats.timeouts;
+	bool res;
+
+	if (!aem->eep || !hw_health_ok(aem, &aem->eep_health))
+		return false;
+
+	res = aem->eep->read(aem, off, data);
+	hw_health_update(aem, &aem->eep_health, "EEPROM", res, timeouts);
+	if (!res)
 		return false;
 
 	if (aem->eep_io_swap)
@@ -590,15 +913,52 @@ bool hw_eeprom_read(struct atheepmgr *aem, uint32_t off, uint16_t *data)
 	return true;
 }
 
+/**
+ * Read a range of EEPROM words at once, connector could copy the whole range
+ * in a single shot, otherwise fallback to the per-word reading. In any case
+ * the byteswapping is performed in a single pass over the whole range.
+ */
+bool hw_eeprom_read_range(struct atheepmgr *aem, uint32_t off, uint16_t *buf,
+			  unsigned int cnt)
+{
+	unsigned long timeouts = aem->wait_stats.timeouts;
+	unsigned int i;
+	bool res = true;
+
+	if (!aem->eep || !hw_health_ok(aem, &aem->eep_health))
+		return false;
+
+	if (aem->eep->read_range) {
+		res = aem->eep->read_range(aem, off, buf, cnt);
+	} else {
+		for (i = 0; i < cnt && res; ++i)
+			res = aem->eep->read(aem, off + i, &buf[i]);
+	}
+	hw_health_update(aem, &aem->eep_health, "EEPROM", res, timeouts);
+	if (!res)
+		return false;
+
+	if (aem->eep_io_swap)
+		bswap_16_buf(buf, cnt);
+
+	return true;
+}
+
 bool hw_eeprom_write(struct atheepmgr *aem, uint32_t off, uint16_t data)
 {
+	unsigned long timeouts = aem->wait_stats.timeouts;
+	bool res;
+
 	if (aem->eep_io_swap)
 		data = bswap_16(data);
 
-	if (!aem->eep || !aem->eep->write(aem, off, data))
+	if (!aem->eep || !hw_health_ok(aem, &aem->eep_health))
 		return false;
 
-	return true;
+	res = aem->eep->write(aem, off, data);
+	hw_health_update(aem, &aem->eep_health, "EEPROM", res, timeouts);
+
+	return res;
 }
 
 void hw_eeprom_lock(struct atheepmgr *aem, int lock)
@@ -609,6 +969,8 @@ void hw_eeprom_lock(struct atheepmgr *aem, int lock)
 
 void hw_otp_set_ops(struct atheepmgr *aem)
 {
+	aem->otp_cache_len = 0;
+
 	if (aem->con->otp) {
 		if (aem->verbose)
 			printf("OTP access ops: use connector's ops\n");
@@ -633,18 +995,79 @@ void hw_otp_set_ops(struct atheepmgr *aem)
 
 bool hw_otp_enable(struct atheepmgr *aem, int enable)
 {
+	unsigned long timeouts = aem->wait_stats.timeouts;
+	bool res;
+
+	aem->otp_cache_len = 0;
+
 	if (!aem->otp || !aem->otp->enable)
 		return true;
 
-	return aem->otp->enable(aem, enable);
+	if (enable && !hw_health_ok(aem, &aem->otp_health))
+		return false;
+
+	res = aem->otp->enable(aem, enable);
+	hw_health_update(aem, &aem->otp_health, "OTP memory", res, timeouts);
+
+	return res;
 }
 
 bool hw_otp_read(struct atheepmgr *aem, uint32_t off, uint8_t *data)
 {
-	if (!aem->otp)
+	unsigned long timeouts = aem->wait_stats.timeouts;
+	bool res;
+
+	if (!aem->otp || !hw_health_ok(aem, &aem->otp_health))
 		return false;
 
-	return aem->otp->read(aem, off, data);
+	res = aem->otp->read(aem, off, data);
+	hw_health_update(aem, &aem->otp_health, "OTP memory", res, timeouts);
+
+	return res;
+}
+
+bool hw_otp_read_bulk(struct atheepmgr *aem, uint32_t off, uint8_t *buf,
+		      unsigned int len)
+{
+	unsigned long timeouts = aem->wait_stats.timeouts;
+	bool res = true;
+
+	if (!aem->otp || !hw_health_ok(aem, &aem->otp_health))
+		return false;
+
+	if (aem->otp->read_bulk) {
+		res = aem->otp->read_bulk(aem, off, buf, len);
+	} else {
+		for (; len && res; --len, ++off, ++buf)
+			res = aem->otp->read(aem, off, buf);
+	}
+	hw_health_update(aem, &aem->otp_health, "OTP memory", res, timeouts);
+
+	return res;
+}
+
+/**
+ * Estimate the size of the register space that will be accessed by the
+ * hardware code. Until the chip revision is known, only the SREV register
+ * could be accessed.
+ */
+uint32_t hw_regs_footprint(struct atheepmgr *aem)
+{
+	uint32_t sz = 0;
+
+	if (AR_SREV_9880(aem))
+		sz = QCA988X_OTP_DATA + 4 * 0x400;	/* OTP window */
+	else if (AR_SREV_9300_20_OR_LATER(aem))
+		sz = AR9300_OTP_READ_DATA + 4;
+	else if (AR_SREV_5416_OR_LATER(aem))
+		sz = 0x40c8 + 4;	/* AR9340 EEPROM status */
+	else if (AR_SREV_5211_OR_LATER(aem))
+		sz = AR5211_EEPROM_STATUS + 4;
+
+	if (aem->eepmap && aem->eepmap->chip_regs.srev + 4 > sz)
+		sz = aem->eepmap->chip_regs.srev + 4;
+
+	return sz;
 }
 
 int hw_init(struct atheepmgr *aem)
@@ -663,6 +1086,10 @@ int hw_init(struct atheepmgr *aem)
 			aem->eep_wp_gpio_num = EEP_WP_GPIO_NONE;
 	} if (AR_SREV_5416_OR_LATER(aem)) {
 		aem->gpio = &gpio_ops_ar9xxx;
+		hw_reg_shadow_declare(aem, AR9XXX_GPIO_OE_OUT);
+		hw_reg_shadow_declare(aem, AR9XXX_GPIO_OUTPUT_MUX1);
+		hw_reg_shadow_declare(aem, AR9XXX_GPIO_OUTPUT_MUX2);
+		hw_reg_shadow_declare(aem, AR9XXX_GPIO_OUTPUT_MUX3);
 
 		if (AR_SREV_9300_20_OR_LATER(aem))
 			aem->gpio_num = 17;
@@ -677,6 +1104,8 @@ int hw_init(struct atheepmgr *aem)
 	} else if (AR_SREV_5211_OR_LATER(aem)) {
 		aem->gpio = &gpio_ops_ar5xxx;
 		aem->gpio_num = 6;
+		hw_reg_shadow_declare(aem, AR5XXX_GPIO_CTRL);
+		hw_reg_shadow_declare(aem, AR5XXX_GPIO_OUT);
 	} else {
 		fprintf(stderr, "Unable to configure chip GPIO support\n");
 	}
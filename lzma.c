@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2020 Sergey Ryazanov <ryazanov.s.a@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Minimal LZMA decoder for the small compressed EEPROM blocks. The whole
+ * output is decoded to the caller's buffer, which is used as the dictionary
+ * as well, so the memory usage is bounded by the output size and by the
+ * probabilities table, which size is limited via the LZMA_LCLP_MAX. The
+ * decoder follows the LZMA specification (lzma-specification.txt from the
+ * LZMA SDK).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lzma.h"
+
+#define LZMA_NUM_STATES		12
+#define LZMA_POS_BITS_MAX	4
+#define LZMA_LEN_LOW_BITS	3
+#define LZMA_LEN_MID_BITS	3
+#define LZMA_LEN_HIGH_BITS	8
+#define LZMA_LEN_MIN		2
+#define LZMA_LEN_TO_POS_STATES	4
+#define LZMA_POS_SLOT_BITS	6
+#define LZMA_END_POS_MODEL_IDX	14
+#define LZMA_FULL_DISTANCES	(1 << (LZMA_END_POS_MODEL_IDX >> 1))
+#define LZMA_ALIGN_BITS		4
+
+#define LZMA_PROB_BITS		11
+#define LZMA_PROB_INIT		(1 << (LZMA_PROB_BITS - 1))
+#define LZMA_MOVE_BITS		5
+#define LZMA_TOP_VALUE		(1U << 24)
+
+struct lzma_rc {
+	const uint8_t *in;
+	const uint8_t *end;
+	uint32_t range;
+	uint32_t code;
+	int err;
+};
+
+struct lzma_len_dec {
+	uint16_t choice;
+	uint16_t choice2;
+	uint16_t low[1 << LZMA_POS_BITS_MAX][1 << LZMA_LEN_LOW_BITS];
+	uint16_t mid[1 << LZMA_POS_BITS_MAX][1 << LZMA_LEN_MID_BITS];
+	uint16_t high[1 << LZMA_LEN_HIGH_BITS];
+};
+
+struct lzma_dec {
+	struct lzma_rc rc;
+	unsigned lc, lp, pb;
+	uint16_t is_match[LZMA_NUM_STATES << LZMA_POS_BITS_MAX];
+	uint16_t is_rep[LZMA_NUM_STATES];
+	uint16_t is_rep_g0[LZMA_NUM_STATES];
+	uint16_t is_rep_g1[LZMA_NUM_STATES];
+	uint16_t is_rep_g2[LZMA_NUM_STATES];
+	uint16_t is_rep0_long[LZMA_NUM_STATES << LZMA_POS_BITS_MAX];
+	uint16_t pos_slot[LZMA_LEN_TO_POS_STATES][1 << LZMA_POS_SLOT_BITS];
+	uint16_t pos_special[1 + LZMA_FULL_DISTANCES - LZMA_END_POS_MODEL_IDX];
+	uint16_t align[1 << LZMA_ALIGN_BITS];
+	struct lzma_len_dec len_dec;
+	struct lzma_len_dec rep_len_dec;
+	uint16_t literal[0x300 << LZMA_LCLP_MAX];
+};
+
+static uint8_t lzma_rc_byte(struct lzma_rc *rc)
+{
+	if (rc->in == rc->end) {
+		rc->err = 1;
+		return 0;
+	}
+
+	return *rc->in++;
+}
+
+static void lzma_rc_init(struct lzma_rc *rc, const uint8_t *in, size_t len)
+{
+	int i;
+
+	rc->in = in;
+	rc->end = in + len;
+	rc->range = 0xffffffff;
+	rc->code = 0;
+	rc->err = lzma_rc_byte(rc) != 0;
+	for (i = 0; i < 4; ++i)
+		rc->code = (rc->code << 8) | lzma_rc_byte(rc);
+	if (rc->code == rc->range)
+		rc->err = 1;
+}
+
+static void lzma_rc_normalize(struct lzma_rc *rc)
+{
+	if (rc->range < LZMA_TOP_VALUE) {
+		rc->range <<= 8;
+		rc->code = (rc->code << 8) | lzma_rc_byte(rc);
+	}
+}
+
+static unsigned lzma_rc_bit(struct lzma_rc *rc, uint16_t *prob)
+{
+	uint32_t bound = (rc->range >> LZMA_PROB_BITS) * *prob;
+	unsigned bit;
+
+	if (rc->code < bound) {
+		*prob += ((1 << LZMA_PROB_BITS) - *prob) >> LZMA_MOVE_BITS;
+		rc->range = bound;
+		bit = 0;
+	} else {
+		*prob -= *prob >> LZMA_MOVE_BITS;
+		rc->code -= bound;
+		rc->range -= bound;
+		bit = 1;
+	}
+	lzma_rc_normalize(rc);
+
+	return bit;
+}
+
+static uint32_t lzma_rc_direct(struct lzma_rc *rc, unsigned nbits)
+{
+	uint32_t res = 0;
+
+	while (nbits--) {
+		rc->range >>= 1;
+		if (rc->code >= rc->range) {
+			rc->code -= rc->range;
+			res = (res << 1) | 1;
+		} else {
+			res <<= 1;
+		}
+		lzma_rc_normalize(rc);
+	}
+
+	return res;
+}
+
+static unsigned lzma_bittree(struct lzma_rc *rc, uint16_t *probs,
+			     unsigned nbits)
+{
+	unsigned m = 1, i;
+
+	for (i = 0; i < nbits; ++i)
+		m = (m << 1) | lzma_rc_bit(rc, &probs[m]);
+
+	return m - (1 << nbits);
+}
+
+static unsigned lzma_bittree_rev(struct lzma_rc *rc, uint16_t *probs,
+				 unsigned nbits)
+{
+	unsigned m = 1, sym = 0, i, bit;
+
+	for (i = 0; i < nbits; ++i) {
+		bit = lzma_rc_bit(rc, &probs[m]);
+		m = (m << 1) | bit;
+		sym |= bit << i;
+	}
+
+	return sym;
+}
+
+static unsigned lzma_len(struct lzma_rc *rc, struct lzma_len_dec *ld,
+			 unsigned pos_state)
+{
+	if (!lzma_rc_bit(rc, &ld->choice))
+		return lzma_bittree(rc, ld->low[pos_state], LZMA_LEN_LOW_BITS);
+	if (!lzma_rc_bit(rc, &ld->choice2))
+		return (1 << LZMA_LEN_LOW_BITS) +
+		       lzma_bittree(rc, ld->mid[pos_state], LZMA_LEN_MID_BITS);
+
+	return (1 << LZMA_LEN_LOW_BITS) + (1 << LZMA_LEN_MID_BITS) +
+	       lzma_bittree(rc, ld->high, LZMA_LEN_HIGH_BITS);
+}
+
+static uint32_t lzma_dist(struct lzma_dec *d, unsigned len)
+{
+	unsigned len_state = len < LZMA_LEN_TO_POS_STATES - 1 ? len :
+			     LZMA_LEN_TO_POS_STATES - 1;
+	unsigned slot, nbits;
+	uint32_t dist;
+
+	slot = lzma_bittree(&d->rc, d->pos_slot[len_state],
+			    LZMA_POS_SLOT_BITS);
+	if (slot < 4)
+		return slot;
+
+	nbits = (slot >> 1) - 1;
+	dist = (2 | (slot & 1)) << nbits;
+	if (slot < LZMA_END_POS_MODEL_IDX)
+		return dist + lzma_bittree_rev(&d->rc,
+					       d->pos_special + dist - slot,
+					       nbits);
+
+	dist += lzma_rc_direct(&d->rc, nbits - LZMA_ALIGN_BITS) <<
+		LZMA_ALIGN_BITS;
+
+	return dist + lzma_bittree_rev(&d->rc, d->align, LZMA_ALIGN_BITS);
+}
+
+static void lzma_init_probs(uint16_t *probs, size_t num)
+{
+	while (num--)
+		*probs++ = LZMA_PROB_INIT;
+}
+
+/**
+ * Decode the LZMA stream with the 13 bytes header (as produced by the
+ * lzma_alone utility) to the output buffer. The unpacked size field could be
+ * unknown (all ones), then the stream should be terminated by the end marker.
+ * Returns the decoded data length or -1 on error.
+ */
+int lzma_decode(uint8_t *out, size_t out_size, const uint8_t *in,
+		size_t in_len)
+{
+	uint32_t rep0 = 0, rep1 = 0, rep2 = 0, rep3 = 0, dist;
+	unsigned state = 0, pos_state, len, sym, mbyte, mbit, bit, i;
+	uint64_t unpack_size = 0;
+	struct lzma_dec *d;
+	size_t pos = 0;
+	uint16_t *probs;
+	int res = -1;
+
+	if (in_len < LZMA_HDR_LEN || in[0] >= 9 * 5 * 5)
+		return -1;
+	for (i = 0; i < 8; ++i)
+		unpack_size |= (uint64_t)in[5 + i] << (8 * i);
+	if (unpack_size != ~0ULL && unpack_size > out_size)
+		return -1;
+
+	d = malloc(sizeof(*d));
+	if (!d)
+		return -1;
+
+	d->lc = in[0] % 9;
+	d->lp = (in[0] / 9) % 5;
+	d->pb = in[0] / (9 * 5);
+	if (d->lc + d->lp > LZMA_LCLP_MAX || d->pb > LZMA_POS_BITS_MAX)
+		goto out;
+
+	/* All the probabilities are adjacent uint16_t arrays */
+	lzma_init_probs(d->is_match, (offsetof(struct lzma_dec, literal) -
+			offsetof(struct lzma_dec, is_match)) / sizeof(uint16_t) +
+			(0x300 << (d->lc + d->lp)));
+
+	lzma_rc_init(&d->rc, in + LZMA_HDR_LEN, in_len - LZMA_HDR_LEN);
+
+	while (!d->rc.err) {
+		if (unpack_size != ~0ULL && pos == unpack_size &&
+		    d->rc.code == 0) {
+			res = pos;
+			break;
+		}
+
+		pos_state = pos & ((1 << d->pb) - 1);
+
+		if (!lzma_rc_bit(&d->rc, &d->is_match[(state <<
+						LZMA_POS_BITS_MAX) + pos_state])) {
+			if (pos == out_size || pos == unpack_size)
+				break;
+			probs = &d->literal[0x300 *
+				(((pos & ((1 << d->lp) - 1)) << d->lc) +
+				 ((pos ? out[pos - 1] : 0) >> (8 - d->lc)))];
+			sym = 1;
+			if (state >= 7) {
+				mbyte = out[pos - rep0 - 1];
+				do {
+					mbit = (mbyte >> 7) & 1;
+					mbyte <<= 1;
+					bit = lzma_rc_bit(&d->rc,
+						&probs[((1 + mbit) << 8) + sym]);
+					sym = (sym << 1) | bit;
+				} while (mbit == bit && sym < 0x100);
+			}
+			while (sym < 0x100)
+				sym = (sym << 1) | lzma_rc_bit(&d->rc,
+							       &probs[sym]);
+			out[pos++] = sym;
+			state = state < 4 ? 0 : state < 10 ? state - 3 :
+							      state - 6;
+			continue;
+		}
+
+		if (lzma_rc_bit(&d->rc, &d->is_rep[state])) {
+			if (pos == 0 || pos == out_size || pos == unpack_size)
+				break;
+			if (!lzma_rc_bit(&d->rc, &d->is_rep_g0[state])) {
+				if (!lzma_rc_bit(&d->rc, &d->is_rep0_long[(state <<
+						LZMA_POS_BITS_MAX) + pos_state])) {
+					state = state < 7 ? 9 : 11;
+					out[pos] = out[pos - rep0 - 1];
+					pos++;
+					continue;
+				}
+			} else {
+				if (!lzma_rc_bit(&d->rc, &d->is_rep_g1[state])) {
+					dist = rep1;
+				} else {
+					if (!lzma_rc_bit(&d->rc,
+							 &d->is_rep_g2[state])) {
+						dist = rep2;
+					} else {
+						dist = rep3;
+						rep3 = rep2;
+					}
+					rep2 = rep1;
+				}
+				rep1 = rep0;
+				rep0 = dist;
+			}
+			len = lzma_len(&d->rc, &d->rep_len_dec, pos_state);
+			state = state < 7 ? 8 : 11;
+		} else {
+			rep3 = rep2;
+			rep2 = rep1;
+			rep1 = rep0;
+			len = lzma_len(&d->rc, &d->len_dec, pos_state);
+			state = state < 7 ? 7 : 10;
+			rep0 = lzma_dist(d, len);
+			if (rep0 == 0xffffffff) {	/* End marker */
+				if (d->rc.code == 0 && !d->rc.err &&
+				    (unpack_size == ~0ULL ||
+				     pos == unpack_size))
+					res = pos;
+				break;
+			}
+			if (rep0 >= pos)
+				break;
+		}
+
+		len += LZMA_LEN_MIN;
+		if (len > out_size - pos ||
+		    (unpack_size != ~0ULL && len > unpack_size - pos))
+			break;
+		for (; len; --len, ++pos)
+			out[pos] = out[pos - rep0 - 1];
+	}
+
+out:
+	free(d);
+
+	return res;
+}
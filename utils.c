@@ -15,8 +15,14 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
 #include <stdint.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #include "utils.h"
 
@@ -50,3 +56,69 @@ void hexdump_print(const void *buf, int len)
 		printf("|\n");
 	}
 }
+
+/**
+ * Swap octets of each 16-bits word of the buffer. Process four words at once
+ * with the 64-bits arithmetic, and then the tail word by word.
+ */
+void bswap_16_buf(uint16_t *buf, size_t cnt)
+{
+	uint64_t v;
+
+	for (; cnt >= 4; cnt -= 4, buf += 4) {
+		memcpy(&v, buf, sizeof(v));
+		v = ((v & 0x00ff00ff00ff00ffULL) << 8) |
+		    ((v >> 8) & 0x00ff00ff00ff00ffULL);
+		memcpy(buf, &v, sizeof(v));
+	}
+
+	for (; cnt; --cnt, ++buf)
+		*buf = (*buf << 8) | (*buf >> 8);
+}
+
+/**
+ * Copy the buffer in the reverse bytes order, so the last source byte becomes
+ * the first destination one. Process 16 bytes at once with the bytes shuffle
+ * if the SSSE3 or NEON instructions are available to the compiler, then 8
+ * bytes at once with the 64-bits arithmetic, and then the tail byte by byte.
+ */
+void memcpy_rev(void *dst, const void *src, size_t len)
+{
+	const uint8_t *s = (const uint8_t *)src + len;
+	uint8_t *d = dst;
+	uint64_t v;
+
+#if defined(__SSSE3__)
+	const __m128i rev = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+					 12, 13, 14, 15);
+	__m128i x;
+
+	for (; len >= 16; len -= 16, d += 16) {
+		s -= 16;
+		x = _mm_loadu_si128((const __m128i *)s);
+		_mm_storeu_si128((__m128i *)d, _mm_shuffle_epi8(x, rev));
+	}
+#elif defined(__ARM_NEON)
+	uint8x16_t x;
+
+	for (; len >= 16; len -= 16, d += 16) {
+		s -= 16;
+		x = vrev64q_u8(vld1q_u8(s));
+		vst1q_u8(d, vcombine_u8(vget_high_u8(x), vget_low_u8(x)));
+	}
+#endif
+
+	for (; len >= 8; len -= 8, d += 8) {
+		s -= 8;
+		memcpy(&v, s, sizeof(v));
+		v = ((v & 0x00ff00ff00ff00ffULL) << 8) |
+		    ((v >> 8) & 0x00ff00ff00ff00ffULL);
+		v = ((v & 0x0000ffff0000ffffULL) << 16) |
+		    ((v >> 16) & 0x0000ffff0000ffffULL);
+		v = (v << 32) | (v >> 32);
+		memcpy(d, &v, sizeof(v));
+	}
+
+	while (len--)
+		*d++ = *--s;
+}
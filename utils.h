@@ -17,6 +17,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -34,5 +35,7 @@ static inline bool macaddr_is_valid(const uint8_t *mac)
 
 int macaddr_parse(const char *str, uint8_t *out);
 void hexdump_print(const void *buf, int len);
+void bswap_16_buf(uint16_t *buf, size_t cnt);
+void memcpy_rev(void *dst, const void *src, size_t len);
 
 #endif	/* UTILS_H */